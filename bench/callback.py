@@ -0,0 +1,67 @@
+#! /usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+Copyright (C) 2012 by Hatuka*nezumi - IKEDA Soji.
+
+This file is part of the pytextseg package.  This program is free
+software; you can redistribute it and/or modify it under the terms of
+either the GNU General Public License or the Artistic License, as
+specified in the README file.
+
+Measure overhead of Python callbacks called by LineBreak.wrap() and
+fold().  Time per call of callback is shown for each kind of callback.
+'''
+import sys
+import time
+import textseg
+from textseg import LineBreak
+
+PARA = ('Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do '
+        'eiusmod tempor incididunt ut labore et dolore magna aliqua. ') * 4 + \
+       '\n'
+
+calls = [0]
+
+def format(self, action, s):
+    calls[0] += 1
+    return None
+
+def sizing(self, cols, pre, spc, s):
+    calls[0] += 1
+    return cols + spc.cols + s.cols
+
+def urgent(self, s):
+    calls[0] += 1
+    return [s]
+
+def bench(func, text, repeat = 3):
+    best = None
+    for i in range(repeat):
+        calls[0] = 0
+        t = time.time()
+        func(text)
+        t = time.time() - t
+        if best is None or t < best:
+            best = t
+    return best, calls[0]
+
+def main(argv):
+    size = int(argv[1]) if len(argv) > 1 else 100000
+    text = (PARA * (size // len(PARA) + 1))[:size]
+    cases = [
+        ('format', LineBreak(format=format).wrap),
+        ('sizing', LineBreak(sizing=sizing).wrap),
+        ('urgent', LineBreak(width=4, urgent=urgent).wrap),
+        ('fold', lambda s: textseg.fold(s, 'FLOWED')),
+        ]
+    print('%-10s %12s %10s %14s' % ('callback', 'seconds', 'calls',
+                                    'usec/call'))
+    for name, func in cases:
+        t, n = bench(func, text)
+        if name == 'fold':
+            print('%-10s %12.4f %10s %14s' % (name, t, '-', '-'))
+        else:
+            print('%-10s %12.4f %10d %14.3f' % (name, t, n, t * 1e6 / n))
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,77 @@
+#! /usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+Copyright (C) 2012 by Hatuka*nezumi - IKEDA Soji.
+
+This file is part of the pytextseg package.  This program is free
+software; you can redistribute it and/or modify it under the terms of
+either the GNU General Public License or the Artistic License, as
+specified in the README file.
+
+Measure LineBreak.wrap() by each internal representation of text
+(PEP 393 kind).  Memory is reported as growth of peak resident set size
+per input character ("peak bytes/char"), by a child process for each
+kind.  It shows buffers allocated for the text, such as a widened copy,
+not bytes read or written while breaking.
+'''
+import os
+import subprocess
+import sys
+import time
+
+try:
+    unichr
+except NameError:
+    unichr = chr
+
+SAMPLES = {
+    '1byte': 'Lorem ipsum dolor sit amet, consectetur adipiscing elit. ',
+    '2byte': 'Lorem ipsum dolor sit amet, ' + unichr(0x3042) * 8 + '. ',
+    '4byte': 'Lorem ipsum dolor sit amet, ' + unichr(0x1F600) * 4 + '. ',
+}
+for k in SAMPLES:
+    SAMPLES[k] = SAMPLES[k] * 8 + '\n'
+
+def maxrss():
+    try:
+        import resource
+    except ImportError:
+        return 0
+    rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    if sys.platform == 'darwin':
+        return rss
+    return rss * 1024
+
+def child(kind, size):
+    from textseg import LineBreak
+
+    text = SAMPLES[kind] * (size // len(SAMPLES[kind]) + 1)
+    text = text[:size]
+    lb = LineBreak(format=None)
+    # warm up by small text.
+    lb.wrap(text[:1000])
+    base = maxrss()
+    t = time.time()
+    lines = lb.wrap(text)
+    t = time.time() - t
+    print('%d %f %d' % (size, t, maxrss() - base))
+
+def main(argv):
+    if 2 < len(argv) and argv[1] == '--child':
+        child(argv[2], int(argv[3]))
+        return
+
+    size = 1 < len(argv) and int(argv[1]) or 2000000
+    print('%6s %10s %12s %14s %17s' %
+          ('kind', 'chars', 'seconds', 'usec/char', 'peak bytes/char'))
+    for kind in ('1byte', '2byte', '4byte'):
+        out = subprocess.Popen([sys.executable, os.path.abspath(__file__),
+                                '--child', kind, str(size)],
+                               stdout=subprocess.PIPE).communicate()[0]
+        chars, t, rss = out.split()
+        chars, t, rss = int(chars), float(t), int(rss)
+        print('%6s %10d %12.4f %14.3f %17.1f' %
+              (kind, chars, t, t * 1e6 / chars, float(rss) / chars))
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,53 @@
+#! /usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+Copyright (C) 2012 by Hatuka*nezumi - IKEDA Soji.
+
+This file is part of the pytextseg package.  This program is free
+software; you can redistribute it and/or modify it under the terms of
+either the GNU General Public License or the Artistic License, as
+specified in the README file.
+
+Measure conversion of results into Unicode objects by unicode() of GCStr
+for ASCII, Latin-1 and texts widened at the end, where leading runs are
+narrowed by SIMD instructions if available.  Run by builds to be compared.
+'''
+import sys
+import time
+from textseg import GCStr
+
+try:
+    unicode, unichr
+except NameError:
+    unicode = str
+    unichr = chr
+
+SAMPLES = {
+    'ascii': 'Lorem ipsum dolor sit amet, consectetur adipiscing elit. ',
+    'latin1': 'Lorem ipsum dolor sit am' + unichr(0xE9) + 't, ' +
+              'consectetur adipiscing elit. ',
+}
+
+def main(argv):
+    size = 1 < len(argv) and int(argv[1]) or 1000000
+    count = 2 < len(argv) and int(argv[2]) or 20
+    texts = []
+    for kind in ('ascii', 'latin1'):
+        text = SAMPLES[kind] * (size // len(SAMPLES[kind]) + 1)
+        texts.append((kind, text[:size]))
+        texts.append((kind + '+wide', text[:size - 1] + unichr(0x3042)))
+
+    print('%12s %10s %12s %14s' % ('text', 'chars', 'seconds', 'nsec/char'))
+    for kind, text in texts:
+        g = GCStr(text)
+        # warm up.
+        unicode(g)
+        t = time.time()
+        for i in range(count):
+            unicode(g)
+        t = time.time() - t
+        print('%12s %10d %12.4f %14.3f' %
+              (kind, size, t, t * 1e9 / (size * count)))
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,51 @@
+#! /usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+Copyright (C) 2012 by Hatuka*nezumi - IKEDA Soji.
+
+This file is part of the pytextseg package.  This program is free
+software; you can redistribute it and/or modify it under the terms of
+either the GNU General Public License or the Artistic License, as
+specified in the README file.
+
+Measure LineBreak.wrap() with user-defined prep regexes.  Time per
+character should stay flat as input grows.
+'''
+import re
+import sys
+import time
+from textseg import LineBreak
+
+PARA = ('Lorem ipsum dolor sit amet, see http://example.com/path/to/page '
+        'and #hashtag or mailto:someone@example.org for details. ') * 4 + \
+       '\n'
+
+urire = re.compile(r'(?:[a-z][-0-9a-z+.]+://|mailto:)[\x21-\x7E]+', re.I)
+tagre = re.compile(r'#\w+', re.U)
+
+def nonBreak(self, s):
+    return s
+
+def bench(size, repeat = 3):
+    text = PARA * (size // len(PARA) + 1)
+    text = text[:size]
+    lb = LineBreak(prep=[(urire, nonBreak), (tagre, nonBreak)])
+    best = None
+    for i in range(repeat):
+        t = time.time()
+        lb.wrap(text)
+        t = time.time() - t
+        if best is None or t < best:
+            best = t
+    return best
+
+def main(argv):
+    sizes = [int(x) for x in argv[1:]] or \
+            [10000, 20000, 40000, 80000, 160000]
+    print('%10s %12s %14s' % ('chars', 'seconds', 'usec/char'))
+    for size in sizes:
+        t = bench(size)
+        print('%10d %12.4f %14.3f' % (size, t, t * 1e6 / size))
+
+if __name__ == '__main__':
+    main(sys.argv)
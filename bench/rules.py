@@ -0,0 +1,64 @@
+#! /usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+Copyright (C) 2012 by Hatuka*nezumi - IKEDA Soji.
+
+This file is part of the pytextseg package.  This program is free
+software; you can redistribute it and/or modify it under the terms of
+either the GNU General Public License or the Artistic License, as
+specified in the README file.
+
+Measure lookup of breaking rules between pairs of line breaking classes
+by each combination of options affecting them.  unfold() with "FIXED"
+method looks up a rule at each joined line, and breakingRule() looks up
+one per call.  Run by builds to be compared.
+'''
+import sys
+import time
+from textseg import LineBreak
+
+try:
+    unichr
+except NameError:
+    unichr = chr
+
+OPTIONS = ('eastasian_context', 'hangul_as_al', 'legacy_cm',
+           'virama_as_joiner')
+
+# Short lines of Latin, Hangul and ideographs joined by unfold().
+LINES = ['Lorem ipsum dolor', ''.join(unichr(c) for c in range(0xAC00,
+                                                                0xAC40, 7)),
+         ''.join(unichr(c) for c in range(0x4E00, 0x4E10)), 'sit amet,']
+
+PAIRS = [(a, b) for a in ['a', unichr(0xAC00), unichr(0x4E00), unichr(0xA7),
+                          unichr(0x1100), ' ', '(']
+         for b in ['b', unichr(0xB098), unichr(0x3002), unichr(0x0301),
+                   unichr(0x1161), ')']]
+
+def bench(lb, text, count):
+    lb.unfold(text[:1000], 'FIXED')
+    t = time.time()
+    for i in range(count):
+        lb.unfold(text, 'FIXED')
+    u = time.time() - t
+    t = time.time()
+    for i in range(count):
+        for a, b in PAIRS:
+            lb.breakingRule(a, b)
+    return u, time.time() - t
+
+def main(argv):
+    count = int(argv[1]) if 1 < len(argv) else 20
+    text = '\n'.join(LINES * 5000) + '\n'
+    print('%-4s %-4s %-4s %-4s %12s %12s' %
+          ('ea', 'hang', 'lcm', 'vir', 'unfold sec', 'rule sec'))
+    for bits in range(1 << len(OPTIONS)):
+        opts = dict((name, bool(bits & (1 << i)))
+                    for i, name in enumerate(OPTIONS))
+        u, r = bench(LineBreak(**opts), text, count)
+        print('%-4s %-4s %-4s %-4s %12.4f %12.4f' %
+              tuple(['x' if opts[name] else '-' for name in OPTIONS] +
+                    [u, r]))
+
+if __name__ == '__main__':
+    main(sys.argv)
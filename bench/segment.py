@@ -0,0 +1,53 @@
+#! /usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+Copyright (C) 2012 by Hatuka*nezumi - IKEDA Soji.
+
+This file is part of the pytextseg package.  This program is free
+software; you can redistribute it and/or modify it under the terms of
+either the GNU General Public License or the Artistic License, as
+specified in the README file.
+
+Measure segmentation of texts into grapheme clusters by GCStr() for ASCII,
+Latin-1, combining and CJK texts.  Clusters inside long runs of printable
+ASCII characters are made at once, so mostly ASCII texts are expected to
+be faster than others.  Run by builds to be compared.
+'''
+import sys
+import time
+from textseg import GCStr
+
+try:
+    unicode, unichr
+except NameError:
+    unicode = str
+    unichr = chr
+
+SAMPLES = {
+    'ascii': 'Lorem ipsum dolor sit amet, consectetur adipiscing elit. ',
+    'latin1': 'Lorem ipsum dolor sit am' + unichr(0xE9) + 't, ' +
+              'consectetur adipiscing elit. ',
+    'combining': 'Lorem ipsum dolor sit ame' + unichr(0x0301) + 't, ' +
+                 'consectetur adipiscing elit. ',
+    'cjk': ''.join([unichr(c) for c in range(0x3042, 0x3094)]),
+}
+
+def main(argv):
+    size = 1 < len(argv) and int(argv[1]) or 1000000
+    count = 2 < len(argv) and int(argv[2]) or 20
+
+    print('%12s %10s %12s %14s' % ('text', 'chars', 'seconds', 'nsec/char'))
+    for kind in ('ascii', 'latin1', 'combining', 'cjk'):
+        text = SAMPLES[kind] * (size // len(SAMPLES[kind]) + 1)
+        text = text[:size]
+        # warm up.
+        GCStr(text)
+        t = time.time()
+        for i in range(count):
+            GCStr(text)
+        t = time.time() - t
+        print('%12s %10d %12.4f %14.3f' %
+              (kind, size, t, t * 1e9 / (size * count)))
+
+if __name__ == '__main__':
+    main(sys.argv)
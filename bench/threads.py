@@ -0,0 +1,66 @@
+#! /usr/bin/env python
+# -*- coding: utf-8 -*-
+'''
+Copyright (C) 2012 by Hatuka*nezumi - IKEDA Soji.
+
+This file is part of the pytextseg package.  This program is free
+software; you can redistribute it and/or modify it under the terms of
+either the GNU General Public License or the Artistic License, as
+specified in the README file.
+
+Measure throughput of LineBreak.wrap() called by several threads sharing
+one LineBreak object without Python callbacks, and of
+LineBreak.wrap_many() with the same number of native threads.  Throughput
+should scale with number of threads up to number of CPUs.
+'''
+import sys
+import threading
+import time
+from textseg import LineBreak
+
+PARA = ('Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do '
+        'eiusmod tempor incididunt ut labore et dolore magna aliqua. ') * 8 + \
+       '\n'
+
+def bench(lb, text, nthreads, count):
+    expected = [str(l) for l in lb.wrap(text)]
+    errors = []
+
+    def worker():
+        for i in range(count):
+            if [str(l) for l in lb.wrap(text)] != expected:
+                errors.append(i)
+
+    threads = [threading.Thread(target=worker) for i in range(nthreads)]
+    t = time.time()
+    for th in threads:
+        th.start()
+    for th in threads:
+        th.join()
+    t = time.time() - t
+    if errors:
+        raise AssertionError('%d results differ' % len(errors))
+    return t
+
+def bench_many(lb, text, nthreads, count):
+    texts = [text] * (count * nthreads)
+    t = time.time()
+    lb.wrap_many(texts, threads=nthreads)
+    return time.time() - t
+
+def main(argv):
+    nthreads = [int(x) for x in argv[1:]] or [1, 2, 4, 8]
+    size = 100000
+    count = 20
+    text = (PARA * (size // len(PARA) + 1))[:size]
+    lb = LineBreak()
+    for name, func in [('wrap', bench), ('wrap_many', bench_many)]:
+        print('%-10s %8s %12s %14s' %
+              (name, 'threads', 'seconds', 'Mchars/sec'))
+        for n in nthreads:
+            t = func(lb, text, n, count)
+            print('%-10s %8d %12.4f %14.3f' %
+                  ('', n, t, size * count * n / t / 1e6))
+
+if __name__ == '__main__':
+    main(sys.argv)
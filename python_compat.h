@@ -25,6 +25,7 @@ typedef int Py_ssize_t;
 #   endif			/* PY_MINOR_VERSION */
 #   if PY_MINOR_VERSION <= 5
 #       define Py_TYPE(o) ((o)->ob_type)
+#       define Py_REFCNT(o) ((o)->ob_refcnt)
 #       define PyBytes_Check(o) PyString_Check(o)
 #       define PyBytes_AsString(o) PyString_AsString(o)
 #   endif
@@ -90,3 +91,35 @@ typedef Py_UNICODE Py_UCS2;
     } while (0)
 #endif				/* PY_MAJOR_VERSION == 2 ... */
 
+#if PY_VERSION_HEX < 0x03090000
+/*
+ * Vectorcall protocol is available on Python 3.9 or later.  Fake it by
+ * building tuple of arguments.
+ */
+#   define PyObject_Vectorcall(func, args, nargsf, kwnames) \
+        _textseg_Vectorcall(func, args, nargsf)
+static PyObject *
+_textseg_Vectorcall(PyObject * func, PyObject ** args, size_t nargs)
+{
+    PyObject *tuple, *ret;
+    size_t i;
+
+    if ((tuple = PyTuple_New(nargs)) == NULL)
+	return NULL;
+    for (i = 0; i < nargs; i++) {
+	Py_INCREF(args[i]);
+	PyTuple_SET_ITEM(tuple, i, args[i]);
+    }
+    ret = PyObject_CallObject(func, tuple);
+    Py_DECREF(tuple);
+    return ret;
+}
+#endif				/* PY_VERSION_HEX */
+
+#ifndef PYTHREAD_INVALID_THREAD_ID
+/*
+ * Value PyThread_start_new_thread() returns on failure, named by Python
+ * 3.7 or later.
+ */
+#   define PYTHREAD_INVALID_THREAD_ID ((unsigned long)-1)
+#endif				/* PYTHREAD_INVALID_THREAD_ID */
@@ -12,7 +12,7 @@ import os
 import re
 import unittest
 from textseg import GCStr, LineBreak
-from textseg.Consts import lbcAL, lbcGL
+from textseg.Consts import eawF, lbcAL, lbcGL, lbcID
 
 try:
     unicode, unichr
@@ -147,6 +147,55 @@ class GCStrTest(unittest.TestCase):
         string = GCStr(''.join(s))
         self.assertEqual([unicode(c) for c in string], s)
 
+    def test_10gcstring06(self):
+        for s in [unistr(0x41, 0x42), unistr(0x41, 0xE9, 0x42),
+                  unistr(0xE9, 0x41, 0x3042), unistr(0x41) * 100 + unistr(0x100),
+                  unistr(0x3042, 0x41, 0xE9)]:
+            self.assertEqual(unicode(GCStr(s)), s)
+            self.assertEqual(hash(unicode(GCStr(s))), hash(s))
+
+    def test_10gcstring07(self):
+        # A wide character at each position of blocks narrowed at once.
+        for n in (15, 16, 17, 31, 32, 33):
+            for base, wides in ((0x41, (0xE9, 0x3042, 0x1F600)),
+                                (0xE9, (0x3042, 0x1F600))):
+                for wide in wides:
+                    for i in range(n):
+                        s = unistr(*([base] * i + [wide] +
+                                     [base] * (n - i - 1)))
+                        self.assertEqual(unicode(GCStr(s)), s)
+                        self.assertEqual(hash(unicode(GCStr(s))), hash(s))
+                s = unistr(base) * n
+                self.assertEqual(unicode(GCStr(s)), s)
+
+    def test_10gcstring08(self):
+        # Clusters inside long runs of printable ASCII are made at once:
+        # they must be same as clusters made one by one from short text.
+        def clusters(g):
+            return [(unicode(c), c.lbc, c.cols) for c in g]
+
+        for lb in (None, LineBreak(lbc={'b': lbcID}, eaw={'c': eawF})):
+            args = (lb is not None) and (lb,) or ()
+            for mid in [unistr(0x0301), unistr(0x0D, 0x0A), unistr(0x0A),
+                        unistr(0x09), unistr(0x7F), unistr(0x0600),
+                        unistr(0x200D), unistr(0x0903), unistr(0x3042),
+                        unistr(0x1F1EF, 0x1F1F5), unistr(0x1F600)]:
+                for head, tail in (('ab', 'cd'), ('~ ', ' ~')):
+                    short = clusters(GCStr(head + mid + tail, *args))
+                    for n in (14, 15, 16, 17, 31, 32, 33, 300):
+                        text = head[0] * n + head + mid + tail + tail[-1] * n
+                        g = GCStr(text, *args)
+                        self.assertEqual(unicode(g), text)
+                        self.assertEqual(
+                            clusters(g),
+                            clusters(GCStr(head[0], *args)) * n + short +
+                            clusters(GCStr(tail[-1], *args)) * n)
+            text = ''.join([unichr(c) for c in range(0x20, 0x7F)]) * 4
+            self.assertEqual(clusters(GCStr(text, *args)),
+                             [clusters(GCStr(c, *args))[0] for c in text])
+            self.assertEqual(unicode(GCStr(text, *args)[100:200]),
+                             text[100:200])
+
     def test_17prop(self):
         lb = LineBreak(eastasian_context = True)
 
@@ -11,8 +11,10 @@ specified in the README file.
 import os
 import re
 import unittest
-from textseg import LineBreak, LineBreakException, fill, fold, unfold
-from textseg.Consts import eawZ, eawN, lbcID, sea_support, \
+from textseg import LineBreak, LineBreakException, TextWrapper, \
+                    fill, fold, unfold, wrap
+from textseg.Consts import eawZ, eawN, lbcAL, lbcBK, lbcID, lbcSP, \
+                           sea_support, \
                            AMBIGUOUS_ALPHABETICS, KANA_NONSTARTERS
 
 try:
@@ -323,6 +325,483 @@ class LineBreakTest(unittest.TestCase):
                           (r'http://[\x21-\x7e]+', nonBreak),
                           (urire, breakURI)])
 
+    def test_17breakpoints(self):
+        # Inserted newlines don't shift offsets.
+        text = 'aaa bbb ccc ddd\neee'
+        lb = LineBreak(width=10)
+        self.assertEqual(list(lb.breakpoints(text)), [8, 16, 19])
+        self.assertEqual(lb.format, 'simple')
+        self.assertEqual(list(lb.freeze().breakpoints(text)), [8, 16, 19])
+        text = unistr(0x3042) * 12
+        self.assertEqual(list(lb.breakpoints(text)), [5, 10, 12])
+        self.assertEqual(list(LineBreak(width=10, format=None)
+                              .breakpoints(text)), [5, 10, 12])
+        self.assertEqual(list(LineBreak().breakpoints('')), [])
+
+        lb = LineBreak(width=10, prep=[(re.compile('b+'),
+                                        lambda self, s: s.upper())])
+        self.assertRaises(ValueError, lb.breakpoints, text + ' bbb')
+
+    def test_18threads(self):
+        import threading
+        text = unistr(0x41, 0x42, 0x20, 0x3042, 0x3044, 0x20) * 2000
+        lb = LineBreak()
+        expected = [unicode(l) for l in lb.wrap(text)]
+        results = []
+
+        def worker():
+            for i in range(5):
+                results.append([unicode(l) for l in lb.wrap(text)])
+
+        threads = [threading.Thread(target=worker) for i in range(4)]
+        for th in threads:
+            th.start()
+        for th in threads:
+            th.join()
+        self.assertEqual(len(results), 20)
+        for r in results:
+            self.assertEqual(r, expected)
+
+    def test_19wrap_many(self):
+        texts = [unistr(0x41, 0x42, 0x20, 0x3042, 0x3044, 0x20) * n
+                 for n in [0, 1, 10, 1000, 3]] * 3
+        for lb in [LineBreak(), LineBreak(width=10),
+                   LineBreak(format=lambda self, action, s: None)]:
+            expected = [[unicode(l) for l in lb.wrap(t)] for t in texts]
+            for n in [1, 2, 5, 100]:
+                result = lb.wrap_many(texts, threads=n)
+                self.assertEqual([[unicode(l) for l in r] for r in result],
+                                 expected)
+        self.assertEqual(LineBreak().wrap_many([]), [])
+        self.assertRaises(ValueError, LineBreak().wrap_many, [''], threads=0)
+
+    def test_20feed(self):
+        text = (unistr(0x41, 0x42, 0x20, 0x3042, 0x3044, 0x20) * 30 +
+                unistr(0x0A)) * 20
+        for lb in [LineBreak(), LineBreak(width=10)]:
+            expected = [unicode(l) for l in lb.wrap(text)]
+            for size in [1, 13, 1000]:
+                result = []
+                for i in range(0, len(text), size):
+                    result += [unicode(l) for l in lb.feed(text[i:i + size])]
+                result += [unicode(l) for l in lb.flush()]
+                self.assertEqual(result, expected)
+            self.assertEqual(lb.flush(), [])
+            # Pending text is discarded by wrap(), whether text is long
+            # or not.
+            for t in [text[:100], text]:
+                for parallel in [False, 2]:
+                    lb.feed(text[:50])
+                    self.assertEqual([unicode(l) for l in
+                                      lb.wrap(t, parallel=parallel)],
+                                     [unicode(l) for l in LineBreak(
+                                         width=lb.width).wrap(t)])
+                    self.assertEqual(lb.flush(), [])
+
+    def test_21iwrap(self):
+        text = (unistr(0x41, 0x42, 0x20, 0x3042, 0x3044, 0x20) * 1000 +
+                unistr(0x0A)) * 3
+        for lb in [LineBreak(), LineBreak(width=10)]:
+            for t in ['', text]:
+                self.assertEqual([unicode(l) for l in lb.iwrap(t)],
+                                 [unicode(l) for l in lb.wrap(t)])
+        it = LineBreak().iwrap(text)
+        self.assertEqual(iter(it), it)
+        list(it)
+        self.assertRaises(StopIteration, next, it)
+
+        # Changes by callbacks go to the owner, not to the copy breaking.
+        def format(self, action, s):
+            if action == 'sot':
+                self.width = 5
+            return None
+
+        text = 'aaa bbb ccc ddd eee'
+        lb = LineBreak(format=format, width=10)
+        self.assertEqual([unicode(l) for l in lb.iwrap(text)],
+                         [unicode(l) for l in
+                          LineBreak(format=None, width=10).wrap(text)])
+        self.assertEqual(lb.width, 5)
+        it = lb.iwrap(text)
+        lb.width = 10
+        self.assertEqual([unicode(l) for l in it],
+                         [unicode(l) for l in
+                          LineBreak(format=None, width=5).wrap(text)])
+
+    def test_22parallel(self):
+        para = unistr(0x41, 0x42, 0x20, 0x3042, 0x3044, 0x20) * 20
+        for nl in [unistr(0x0A), unistr(0x0D, 0x0A), unistr(0x0D),
+                   unistr(0x2029), unistr(0x0A, 0x0A)]:
+            text = (para + nl) * 2000
+            for lb in [LineBreak(), LineBreak(width=10)]:
+                expected = [unicode(l) for l in lb.wrap(text)]
+                for parallel in [True, 3]:
+                    self.assertEqual([unicode(l) for l in
+                                      lb.wrap(text, parallel=parallel)],
+                                     expected)
+        self.assertRaises(ValueError, LineBreak().wrap, '', parallel=-1)
+        text = (para + unistr(0x0A)) * 10
+        self.assertEqual(fold(text, parallel=True), fold(text))
+
+    def test_23callback_self(self):
+        seen = []
+
+        def format(self, action, s):
+            seen.append(self)
+            return None
+
+        def sizing(self, cols, pre, spc, s):
+            seen.append(self)
+            return cols + spc.cols + s.cols
+
+        lb = LineBreak(format=format, sizing=sizing, width=10)
+        text = 'abc def ghi jkl mno pqr ' * 4
+        lb.wrap(text)
+        list(lb.iwrap(text))
+        lb.feed(text)
+        lb.flush()
+        self.assertTrue(seen)
+        self.assertTrue(all([x is lb for x in seen]))
+
+        del seen[:]
+        lb2 = lb.__copy__()
+        lb2.wrap(text)
+        self.assertTrue(all([x is lb2 for x in seen]))
+
+    def test_24callback_view(self):
+        kept = []
+
+        def format(self, action, s):
+            kept.append((action, s, unicode(s)))
+            if action == 'eol':
+                s[0:1] = 'Z'
+                return s
+            return None
+
+        def sizing(self, cols, pre, spc, s):
+            kept.append((None, s, unicode(s)))
+            return cols + spc.cols + s.cols
+
+        lb = LineBreak(format=format, sizing=sizing, width=10)
+        text = 'abc def ghi jkl mno pqr ' * 4
+        result = [unicode(l) for l in lb.wrap(text)]
+        self.assertEqual(result, ['abc defZ', 'ghi jklZ', 'mno pqrZ'] * 3 +
+                         ['abc defZ', 'ghi jklZ', 'mno pqr '])
+        for action, s, value in kept:
+            if action == 'eol':
+                value = 'Z' + value[1:]
+            self.assertEqual(unicode(s), value)
+
+    def test_25tabsize(self):
+        def sizing(self, cols, pre, spc, s):
+            spcstr = spc + s
+            i = 0
+            for c in spcstr:
+                if c.lbc != lbcSP:
+                    cols += spcstr[i:].cols
+                    break
+                if c == "\t":
+                    if 0 < tabsize:
+                        cols += tabsize - (cols % tabsize)
+                else:
+                    cols += c.cols
+                i = i + 1
+            return cols
+
+        lb = LineBreak(sizing='UAX11_TABS')
+        self.assertEqual(lb.sizing, 'uax11_tabs')
+        self.assertEqual(lb.tabsize, 8)
+        lb.tabsize = 4
+        self.assertEqual(lb.__copy__().tabsize, 4)
+        self.assertEqual(lb.freeze().tabsize, 4)
+        lb.sizing = 'UAX11'
+        self.assertEqual(lb.tabsize, 4)
+        lb.sizing = 'UAX11_TABS'
+        self.assertEqual(lb.tabsize, 4)
+        self.assertRaises(ValueError, setattr, lb, 'tabsize', -1)
+
+        # tabsize is independent of sizing method and order of arguments.
+        lb = LineBreak(tabsize=4)
+        self.assertEqual(lb.sizing, 'uax11')
+        self.assertEqual(lb.tabsize, 4)
+        self.assertEqual(LineBreak(sizing=sizing, tabsize=4).sizing, sizing)
+        self.assertEqual(LineBreak(tabsize=4, sizing=sizing).sizing, sizing)
+        text = 'ab\tcd\t\tefgh' * 8
+        expected = [unicode(l) for l in
+                    LineBreak(sizing='UAX11_TABS', tabsize=4,
+                              width=10).wrap(text)]
+        self.assertEqual([unicode(l) for l in
+                          LineBreak(tabsize=4, sizing='UAX11_TABS',
+                                    width=10).wrap(text)], expected)
+        lb = LineBreak(tabsize=4, width=10)
+        lb.sizing = 'UAX11_TABS'
+        self.assertEqual([unicode(l) for l in lb.wrap(text)], expected)
+
+        text = 'ab\tcd \t\tefgh\t ijklm\tn  \to p\t\tqr ' * 8
+        for tabsize in [8, 3, 0]:
+            for width in [10, 20, 40]:
+                lb = LineBreak(sizing='UAX11_TABS', tabsize=tabsize,
+                               width=width)
+                lb.lbc['\t'] = lbcSP
+                ref = LineBreak(sizing=sizing, width=width)
+                ref.lbc['\t'] = lbcSP
+                self.assertEqual([unicode(l) for l in lb.wrap(text)],
+                                 [unicode(l) for l in ref.wrap(text)])
+
+    def test_26format_mail(self):
+        for meth in ['FIXED', 'FLOWED']:
+            lb = LineBreak(format=meth)
+            self.assertEqual(lb.format, meth.lower())
+            self.assertEqual(lb.__copy__().format, meth.lower())
+
+        para = unistr(0x41, 0x42, 0x20, 0x3042, 0x3044, 0x20) * 20
+        text = ''.join([p + unistr(0x0A) for p in
+                        [para, '> ' + para, '>> ' + para, ' ' + para,
+                         'From ' + para, '', para]]) * 200
+        for meth in ['FIXED', 'FLOWED']:
+            lb = LineBreak(format=meth, width=30)
+            expected = [unicode(l) for l in lb.wrap(text[:2000])]
+            self.assertEqual([unicode(l) for l in lb.wrap(text[:2000])],
+                             expected)
+            self.assertEqual(lb.width, 30)
+            whole = [unicode(l) for l in lb.wrap(text)]
+            self.assertEqual([unicode(l) for l in
+                              lb.wrap(text, parallel=True)], whole)
+            self.assertEqual([unicode(l) for l in lb.iwrap(text)], whole)
+
+        # Width survives breaking stopped within quoted paragraph.
+        lb = LineBreak(format='FIXED', width=30)
+        expected = [unicode(l) for l in lb.wrap(para)]
+        lb.feed('> ' + para)
+        self.assertEqual(lb.width, 30)
+        self.assertEqual([unicode(l) for l in lb.wrap(para)], expected)
+        self.assertEqual(lb.width, 30)
+        self.assertTrue(1 < len(expected))
+        lb.feed('> ' + para)
+        lb.format = 'SIMPLE'
+        self.assertEqual(lb.width, 30)
+
+    def test_27unfold(self):
+        text = 'abc \r\ndef\r\n\r\n> q\r\nx' + unistr(0x0C) + 'y'
+        self.assertEqual(unfold(text),
+                         'abc def\n> q\nx\n' + unistr(0x0C) + 'y\n')
+        self.assertEqual(LineBreak().unfold(text), unfold(text, 'fixed'))
+        text = ('> a \r\n> b\r\n>> c \r\nd \r\n e' + unistr(0x0C) +
+                ' f')
+        self.assertEqual(unfold(text, 'flowed', newline='\r\n'),
+                         '> ab\r\n>> c\r\nde\r\n' + unistr(0x0C) +
+                         'f\r\n')
+        self.assertEqual(unfold(text, 'FLOWEDSP'),
+                         '> a b\n>> c \nd e\n' + unistr(0x0C) + 'f\n')
+        self.assertEqual(unfold(''), '')
+
+    def test_28fold_text(self):
+        para = unistr(0x41, 0x42, 0x20, 0x3042, 0x3044, 0x20) * 20
+        text = ''
+        for sep in [0x0B, 0x0C, 0x85, 0x2028, 0x2029, 0x0A]:
+            text += para + unistr(sep) + unistr(sep)
+        for lb in [LineBreak(), LineBreak(width=10, format='TRIM')]:
+            for t in ['', text, text * 200]:
+                expected = ''
+                seps = unistr(0x0B, 0x0C, 0x85, 0x2028, 0x2029)
+                for s in re.split('([' + seps + '])', t):
+                    if len(s) == 1 and s in seps:
+                        expected += s
+                    else:
+                        expected += ''.join([unicode(l)
+                                             for l in lb.wrap(s)])
+                self.assertEqual(lb.fold_text(t), expected)
+                self.assertEqual(lb.fold_text(t, parallel=True), expected)
+
+    def test_29textwrapper(self):
+        import textseg
+        for lang in ['ja', 'fr']:
+            instring = self.readText(lang + '.in')
+            kwds = {'width': 76, 'initial_indent': ' ' * 8,
+                    'subsequent_indent': ' ' * 4}
+            tw = TextWrapper(**kwds)
+            expected = fill(instring, **kwds)
+            self.assertEqual(tw.fill(instring), expected)
+            self.assertEqual(tw.fill(instring), expected)
+            self.assertEqual(tw.wrap(instring), wrap(instring, **kwds))
+            self.assertEqual(fill(instring, **kwds), expected)
+            self.assertEqual(fold(instring), fold(instring))
+
+        # Options including tailoring dictionaries are cached, also when
+        # DEFAULTS include them.
+        self.assertTrue(isinstance(LineBreak.DEFAULTS['eaw'], dict))
+        textseg._linebreaks.clear()
+        text = 'abc def ghi ' * 10
+        try:
+            wrap(text, width=20)
+            wrap(text, width=20)
+            self.assertEqual(textseg._linebreaks.size, 1)
+            wrap(text, width=30)
+            self.assertEqual(textseg._linebreaks.size, 2)
+            self.assertEqual(wrap(text, width=20, lbc={'a': lbcID}),
+                             wrap(text, width=20, lbc={'a': lbcID}))
+            self.assertEqual(textseg._linebreaks.size, 3)
+            wrap(text, width=20, lbc={'a': lbcAL})
+            self.assertEqual(textseg._linebreaks.size, 4)
+        finally:
+            textseg._linebreaks.clear()
+
+    def test_30freeze(self):
+        import threading
+
+        def format(self, action, s):
+            if action == 'eol':
+                return s * 0 + self['mark'] + self.newline
+            return None
+
+        text = unistr(0x41, 0x42, 0x20, 0x3042, 0x3044, 0x20) * 200
+        lb = LineBreak(format=format, width=30)
+        lb['mark'] = '|'
+        frozen = lb.freeze()
+        lb['mark'] = '#'
+        lb.width = 40
+        self.assertEqual(frozen['mark'], '|')
+        self.assertEqual(frozen.width, 30)
+        self.assertTrue(frozen.freeze() is frozen)
+        self.assertTrue(frozen.__copy__() is frozen)
+
+        self.assertRaises(TypeError, setattr, frozen, 'width', 10)
+        self.assertRaises(TypeError, frozen.__setitem__, 'mark', '#')
+        self.assertRaises(TypeError, frozen.update, {'mark': '#'})
+        self.assertRaises(TypeError, frozen.lbc.__setitem__, 'a', lbcID)
+        self.assertRaises(TypeError, frozen.eaw.clear)
+        self.assertRaises(TypeError, frozen.feed, text)
+        self.assertRaises(TypeError, frozen.flush)
+
+        lb['mark'] = '|'
+        lb.width = 30
+        expected = [unicode(l) for l in lb.wrap(text)]
+        self.assertEqual([unicode(l) for l in frozen.wrap(text)], expected)
+        self.assertEqual(list(frozen.breakpoints(text)),
+                         list(lb.breakpoints(text)))
+        results = []
+
+        def worker():
+            for i in range(5):
+                results.append([unicode(l) for l in frozen.wrap(text)])
+
+        threads = [threading.Thread(target=worker) for i in range(4)]
+        for th in threads:
+            th.start()
+        for th in threads:
+            th.join()
+        self.assertEqual(len(results), 20)
+        for r in results:
+            self.assertEqual(r, expected)
+
+        frozen = LineBreak(format='FIXED', width=10).freeze()
+        text = ('> ' + 'abc def ' * 4 + '\n\n' + 'abc def ' * 4 + '\n') * 300
+        self.assertEqual([unicode(l) for l in frozen.wrap(text)],
+                         [unicode(l) for l in
+                          LineBreak(format='FIXED', width=10).wrap(text)])
+
+    def test_31copy_on_write(self):
+        import copy
+
+        text = unistr(0x41, 0x42, 0x20, 0x3042, 0x3044, 0x20) * 20
+        lb = LineBreak(width=20)
+        lb.lbc[0x3042] = lbcID
+        lb.eaw[0x3044] = eawN
+        expected = [unicode(l) for l in lb.wrap(text)]
+
+        lb2 = copy.copy(lb)
+        lb3 = copy.copy(lb2)
+        self.assertEqual([unicode(l) for l in lb2.wrap(text)], expected)
+        lb2.lbc[0x3042] = lbcAL
+        lb2.width = 30
+        self.assertEqual(lb.lbc[0x3042], lbcID)
+        self.assertEqual(lb3.lbc[0x3042], lbcID)
+        self.assertEqual(lb.width, 20)
+        self.assertEqual(lb3.width, 20)
+        self.assertEqual(lb2.lbc[0x3042], lbcAL)
+        self.assertEqual([unicode(l) for l in lb.wrap(text)], expected)
+        self.assertEqual([unicode(l) for l in lb3.wrap(text)], expected)
+
+        lb.eaw.clear()
+        self.assertEqual(lb3.eaw[0x3044], eawN)
+        del lb3
+        self.assertEqual(lb2.eaw[0x3044], eawN)
+        lb2.eaw.update({0x3042: eawN})
+        self.assertEqual(lb2.eaw[0x3042], eawN)
+        self.assertRaises(KeyError, lb.eaw.__getitem__, 0x3042)
+
+    def test_32rules(self):
+        lb = LineBreak(hangul_as_al=False)
+        ga, na = unistr(0xAC00), unistr(0xB098)
+        self.assertEqual(lb.breakingRule('a', 'b'), LineBreak.PROHIBITED)
+        self.assertEqual(lb.breakingRule(unistr(0x0A), 'a'),
+                         LineBreak.MANDATORY)
+        self.assertEqual(lb.breakingRule('', 'a'), None)
+        rule = lb.breakingRule(ga, na)
+        self.assertNotEqual(rule, LineBreak.PROHIBITED)
+        lb.hangul_as_al = True
+        self.assertEqual(lb.breakingRule(ga, na), LineBreak.PROHIBITED)
+        self.assertEqual(LineBreak(hangul_as_al=True).breakingRule(ga, na),
+                         LineBreak.PROHIBITED)
+        lb.hangul_as_al = False
+        self.assertEqual(lb.breakingRule(ga, na), rule)
+
+    def test_33prep_text(self):
+        # Text searched by prep regexes is converted once per run.
+        class Regex(object):
+            def __init__(self, name, texts):
+                self.name, self.texts = name, texts
+            def search(self, text, pos, endpos):
+                self.texts.append((text, self.name))
+                return None
+
+        texts = []
+        lb = LineBreak(prep=[(Regex('a', texts), lambda self, s: s),
+                             (Regex('b', texts), lambda self, s: s)])
+        for text in ['foo bar baz ' * 10, unistr(0x3042, 0x20) * 3000,
+                     unistr(0x1F600, 0x20) * 3000]:
+            del texts[:]
+            lb.wrap(text)
+            self.assertTrue(texts)
+            for t, name in texts:
+                self.assertEqual(sorted(set([n for u, n in texts
+                                             if u is t])), ['a', 'b'])
+
+    def test_34parallel_tailored_break(self):
+        para = unistr(0x41, 0x42, 0x20, 0x3042, 0x3044, 0x20) * 20
+        text = (para + unistr(0x7C)) * 2000
+        lb = LineBreak(width=30)
+        lb.lbc[0x7C] = lbcBK
+        expected = [unicode(l) for l in lb.wrap(text)]
+        self.assertEqual([unicode(l) for l in lb.wrap(text, parallel=3)],
+                         expected)
+        self.assertEqual(lb.fold_text(text, parallel=3),
+                         ''.join(expected))
+
+        text = (para + unistr(0x2603)) * 2000
+        lb = LineBreak(width=30)
+        lb.lbc.update_ranges([((0x2600, 0x26FF), lbcBK),
+                              ((0x3041, 0x3043), lbcAL)])
+        expected = [unicode(l) for l in lb.wrap(text)]
+        self.assertEqual([unicode(l) for l in lb.wrap(text, parallel=3)],
+                         expected)
+
+    def test_35prep_window(self):
+        # A match of prep regex crosses the 4096th character.
+        uri = 'http://example.com/foo/bar/baz/qux/quux '
+        text = 'a ' * 2040 + uri * 3 + '\n'
+        self.assertTrue(text.index(uri) < 4096 < text.index(uri) + len(uri))
+        lb = LineBreak(width=20, prep=['BREAKURI'])
+        # Text of 4-byte kind is broken at once by wrap().
+        expected = [unicode(l) for l in lb.wrap(text + unistr(0x1F600))]
+        expected = expected[:-1]
+        for wide in ['', unistr(0x3042), unistr(0x1F600)]:
+            for func in [lb.wrap, lb.iwrap]:
+                lines = [unicode(l) for l in func(text + wide)]
+                if wide:
+                    lines = lines[:-1]
+                self.assertEqual(lines, expected)
+
 
 def suite():
     return unittest.makeSuite(LineBreakTest)
@@ -126,6 +126,66 @@ class TDictTest(unittest.TestCase):
 
             count = count + 1
 
+    def test_update_ranges(self):
+        lb = LineBreak(lbc=None, eaw=None)
+        lbc = {}
+        eaw = {}
+
+        count = 0
+        while count < 300:
+            ranges = []
+            idx = randrange(0, 2)
+            for i in range(randrange(1, 8)):
+                beg = randrange(0, 512)
+                end = randrange(0, 512)
+                if beg > end:
+                    beg, end = end, beg
+                prop = randrange(0, 3)
+                for c in range(beg, end + 1):
+                    if idx:
+                        lbc[c] = prop
+                    else:
+                        eaw[c] = prop
+                if randrange(0, 2):
+                    ranges.append(((beg, end), prop))
+                else:
+                    ranges.append((range(beg, end + 1), prop))
+            if idx:
+                lb.lbc.update_ranges(ranges)
+            else:
+                lb.eaw.update_ranges(ranges)
+
+            for c in range(0, 512):
+                if c not in lbc:
+                    self.assertRaises(KeyError, lb.lbc.__getitem__, c)
+                else:
+                    self.assertEqual(lbc[c], lb.lbc[c])
+                if c not in eaw:
+                    self.assertRaises(KeyError, lb.eaw.__getitem__, c)
+                else:
+                    self.assertEqual(eaw[c], lb.eaw[c])
+
+            count = count + 1
+
+        lb = LineBreak(lbc=None, eaw=None)
+        lb.lbc[range(0xE000, 0xF900)] = 2
+        lb.eaw.update_ranges([(('a', 'z'), 1), ((0x20000, 0x2FFFD), 2)])
+        self.assertEqual(lb.lbc[0xE000], 2)
+        self.assertEqual(lb.lbc[0xF8FF], 2)
+        self.assertRaises(KeyError, lb.lbc.__getitem__, 0xF900)
+        self.assertEqual(lb.eaw['m'], 1)
+        self.assertEqual(lb.eaw[0x2A6D6], 2)
+        self.assertRaises(ValueError, lb.lbc.update_ranges,
+                          [((0, 0x110000), 1)])
+
+        # Later assignment wins, even if same value surrounds it.
+        lb = LineBreak(lbc=None, eaw=None)
+        lb.lbc.update_ranges([((2, 9), 1), ((5, 5), 2), ((0, 1), 1),
+                              ((7, 12), 0), ((8, 8), 1)])
+        self.assertEqual([lb.lbc[c] for c in range(0, 13)],
+                         [1, 1, 1, 1, 1, 2, 1, 0, 1, 0, 0, 0, 0])
+        self.assertRaises(KeyError, lb.lbc.__getitem__, 13)
+
 def suite():
     return unittest.makeSuite(TDictTest)
 
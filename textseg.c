@@ -12,12 +12,25 @@
 
 #include <sombok.h>
 #include <Python.h>
+#include "pythread.h"
 #include "structmember.h"
 #include "python_compat.h"
 /* for Win32 with Visual Studio (MSVC) */
 #ifdef _MSC_VER
 #  define strcasecmp _stricmp
 #endif /* _MSC_VER */
+/* for narrowing Unicode string and scanning ASCII runs by SIMD instructions */
+#if !defined(OLDAPI_Py_UNICODE_NARROW) && !defined(OLDAPI_Py_UNICODE_WIDE)
+#  if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#    define SIMD_SSE2
+#    if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || 5 <= __GNUC__)
+#      include <immintrin.h>
+#      define SIMD_AVX2
+#    endif /* __clang__ || __GNUC__ */
+#  endif /* __SSE2__ || _M_X64 */
+#endif /* OLDAPI_Py_UNICODE_NARROW || OLDAPI_Py_UNICODE_WIDE */
 
 /***
  *** Objects
@@ -29,11 +42,31 @@ typedef struct {
     PyObject_HEAD
     linebreak_t * obj;
     struct _TDictObject * tdict;
+    /* Number of objects sharing obj with copies, or NULL if not shared. */
+    size_t * nshare;
+    /* Interval of tab stops used by "UAX11_TABS" sizing method. */
+    double tabsize;
 } LineBreakObject;
 
+#define DEFAULT_TABSIZE (8.0)
+
+/*
+ * Frozen LineBreak object.  obj is never modified nor used for breaking:
+ * texts are broken by private copies of it kept idle for reuse.
+ */
+#define FROZEN_IDLE_MAX (8)
+
+typedef struct {
+    LineBreakObject lbobj;
+    linebreak_t * idle[FROZEN_IDLE_MAX];
+    size_t nidle;
+} FrozenLineBreakObject;
+
 typedef struct {
     PyObject_HEAD
     gcstring_t * obj;
+    int view;			/* obj is borrowed from linebreak library. */
+    gcstring_t empty;		/* obj of view having no string. */
 } GCStrObject;
 
 typedef enum {
@@ -49,12 +82,26 @@ typedef struct _TDictObject {
     struct _TDictObject * next;
 } TDictObject;
 
+/*
+ * Per-paragraph state of built-in "FIXED" and "FLOWED" formats.
+ */
+typedef struct {
+    PyObject_HEAD
+    double width;		/* width of LineBreak object */
+    size_t prefix;		/* number of quotation marks */
+    int line;			/* last line is not empty */
+} FormatStateObject;
+
 static PyTypeObject LineBreak_Type;
+static PyTypeObject FrozenLineBreak_Type;
 static PyTypeObject GCStr_Type;
 static PyTypeObject TDict_Type;
+static PyTypeObject LineBreakIter_Type;
+static PyTypeObject FormatState_Type;
 
 #define LineBreak_Check(op) PyObject_TypeCheck(op, &LineBreak_Type)
 #define LineBreak_CheckExact(op) (Py_TYPE(op) == &LineBreak_Type)
+#define FrozenLineBreak_Check(op) PyObject_TypeCheck(op, &FrozenLineBreak_Type)
 #define GCStr_Check(op) PyObject_TypeCheck(op, &GCStr_Type)
 #define GCStr_CheckExact(op) (Py_TYPE(op) == &GCStr_Type)
 /* TDictObject does not expect subclassing. */
@@ -65,8 +112,10 @@ static PyTypeObject TDict_Type;
  ***/
 
 static PyObject * TEXTSEG_SIMPLE, * TEXTSEG_NEWLINE, * TEXTSEG_TRIM,
+		* TEXTSEG_FIXED, * TEXTSEG_FLOWED,
 		* TEXTSEG_BREAKURI, * TEXTSEG_NONBREAKURI,
-		* TEXTSEG_UAX11, * TEXTSEG_FORCE, * TEXTSEG_RAISE;
+		* TEXTSEG_UAX11, * TEXTSEG_UAX11_TABS,
+		* TEXTSEG_FORCE, * TEXTSEG_RAISE;
 
 /***
  *** Data conversion.
@@ -192,6 +241,180 @@ unicode_ToCstruct(unistr_t * unistr, PyObject * pyobj)
     return unistr;
 }
 
+/*
+ * Get Unicode string from PyUnicodeObject without copying its buffer, if
+ * internal representation of the object is identical to that of Unicode
+ * string.  Otherwise buffer will be copied by unicode_ToCstruct().
+ * If error occurred, exception will be raised and NULL will be returned.
+ * @note *owner will get a new reference to the object buffer of which is
+ * borrowed or NULL.  Unicode string must be released by
+ * unicode_ReleaseCstruct() and must not be modified.
+ */
+static unistr_t *
+unicode_BorrowCstruct(unistr_t * unistr, PyObject * pyobj, PyObject ** owner)
+{
+#ifndef OLDAPI_Py_UNICODE_NARROW
+    PyObject *pystr;
+    int kind;
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
+
+    *owner = NULL;
+    if (pyobj == NULL)
+	return NULL;
+
+#ifndef OLDAPI_Py_UNICODE_NARROW
+    if (PyUnicode_Check(pyobj)) {
+	pystr = pyobj;
+	Py_INCREF(pystr);
+    } else if ((pystr = PyObject_Unicode(pyobj)) == NULL)
+	return NULL;
+
+    if (PyUnicode_READY(pystr) != 0) {
+	Py_DECREF(pystr);
+	return NULL;
+    }
+    kind = PyUnicode_KIND(pystr);
+    if (PyUnicode_GET_LENGTH(pystr) != 0 &&
+	((kind == PyUnicode_1BYTE_KIND &&
+	  sizeof(Py_UCS1) == sizeof(unichar_t)) ||
+	 (kind == PyUnicode_2BYTE_KIND &&
+	  sizeof(Py_UCS2) == sizeof(unichar_t)) ||
+	 (kind == PyUnicode_4BYTE_KIND &&
+	  sizeof(Py_UCS4) == sizeof(unichar_t)))) {
+	unistr->str = (unichar_t *) PyUnicode_DATA(pystr);
+	unistr->len = PyUnicode_GET_LENGTH(pystr);
+	*owner = pystr;
+	return unistr;
+    }
+
+    /* Conversion was done: it need not to be done again. */
+    if (unicode_ToCstruct(unistr, pystr) == NULL) {
+	Py_DECREF(pystr);
+	return NULL;
+    }
+    Py_DECREF(pystr);
+    return unistr;
+#else				/* OLDAPI_Py_UNICODE_NARROW */
+    return unicode_ToCstruct(unistr, pyobj);
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
+}
+
+/*
+ * Release Unicode string got by unicode_BorrowCstruct().
+ */
+static void
+unicode_ReleaseCstruct(unistr_t * unistr, PyObject * owner)
+{
+    if (owner != NULL) {
+	Py_DECREF(owner);
+    } else
+	free(unistr->str);
+    unistr->str = NULL;
+    unistr->len = 0;
+}
+
+#if !defined(OLDAPI_Py_UNICODE_NARROW) && !defined(OLDAPI_Py_UNICODE_WIDE)
+#ifdef SIMD_AVX2
+/*
+ * Check if AVX2 instructions are available at run time.
+ */
+static int
+cpu_has_avx2(void)
+{
+    static int avx2 = -1;
+
+    if (avx2 < 0)
+	avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return avx2;
+}
+#endif				/* SIMD_AVX2 */
+
+/*
+ * Narrowing Unicode string into 1-byte buffer.  Leading characters not
+ * greater than maxchar (0x7F or 0xFF) are copied by runs of 16 or 32
+ * characters checked at once by SSE2 or AVX2, the latter selected at run
+ * time.
+ */
+#ifdef SIMD_SSE2
+static size_t
+ucs1_narrow_sse2(Py_UCS1 * dst, const unichar_t * src, size_t len,
+		 unichar_t maxchar)
+{
+    const __m128i mask = _mm_set1_epi32((int) ~maxchar);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a, b, c, d;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+	a = _mm_loadu_si128((const __m128i *) (src + i));
+	b = _mm_loadu_si128((const __m128i *) (src + i + 4));
+	c = _mm_loadu_si128((const __m128i *) (src + i + 8));
+	d = _mm_loadu_si128((const __m128i *) (src + i + 12));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(
+		_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), mask),
+		zero)) != 0xFFFF)
+	    break;
+	_mm_storeu_si128((__m128i *) (dst + i),
+			 _mm_packus_epi16(_mm_packs_epi32(a, b),
+					  _mm_packs_epi32(c, d)));
+    }
+    return i;
+}
+#endif				/* SIMD_SSE2 */
+
+#ifdef SIMD_AVX2
+__attribute__ ((target("avx2")))
+static size_t
+ucs1_narrow_avx2(Py_UCS1 * dst, const unichar_t * src, size_t len,
+		 unichar_t maxchar)
+{
+    const __m256i mask = _mm256_set1_epi32((int) ~maxchar);
+    const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i a, b, c, d;
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+	a = _mm256_loadu_si256((const __m256i *) (src + i));
+	b = _mm256_loadu_si256((const __m256i *) (src + i + 8));
+	c = _mm256_loadu_si256((const __m256i *) (src + i + 16));
+	d = _mm256_loadu_si256((const __m256i *) (src + i + 24));
+	if (!_mm256_testz_si256(_mm256_or_si256(_mm256_or_si256(a, b),
+						_mm256_or_si256(c, d)),
+				mask))
+	    break;
+	/* Packing works within 128-bit lanes: restore order at last. */
+	_mm256_storeu_si256((__m256i *) (dst + i),
+			    _mm256_permutevar8x32_epi32(
+				_mm256_packus_epi16(_mm256_packs_epi32(a, b),
+						    _mm256_packs_epi32(c, d)),
+				perm));
+    }
+    return i;
+}
+#endif				/* SIMD_AVX2 */
+
+/*
+ * Copy leading characters of src not greater than maxchar (0x7F or 0xFF)
+ * into dst, and return number of characters copied.
+ */
+static size_t
+ucs1_narrow(Py_UCS1 * dst, const unichar_t * src, size_t len,
+	    unichar_t maxchar)
+{
+    size_t i = 0;
+#ifdef SIMD_AVX2
+    if (cpu_has_avx2())
+	i = ucs1_narrow_avx2(dst, src, len, maxchar);
+#endif				/* SIMD_AVX2 */
+#ifdef SIMD_SSE2
+    i += ucs1_narrow_sse2(dst + i, src + i, len - i, maxchar);
+#endif				/* SIMD_SSE2 */
+    for (; i < len && src[i] <= maxchar; i++)
+	dst[i] = (Py_UCS1) src[i];
+    return i;
+}
+#endif /* OLDAPI_Py_UNICODE_NARROW || OLDAPI_Py_UNICODE_WIDE */
+
 /*
  * Convert Unicode string to PyUnicodeObject
  * If error occurred, exception will be raised and NULL will be returned.
@@ -207,8 +430,12 @@ unicode_FromCstruct(unistr_t * unistr)
     size_t len;
     unichar_t unichar;
     int pass;
+#elif defined(OLDAPI_Py_UNICODE_WIDE)
+    int kind;
 #else				/* OLDAPI_Py_UNICODE_NARROW */
     int kind;
+    unichar_t *str, maxchar;
+    PyObject *obj;
 #endif				/* OLDAPI_Py_UNICODE_NARROW */
 
     if (unistr->str == NULL || unistr->len == 0) {
@@ -242,7 +469,7 @@ unicode_FromCstruct(unistr_t * unistr)
     }
     ret = PyUnicode_FromKindAndData(PyUnicode_2BYTE_KIND, ucs, len);
     PyMem_Free(ucs);
-#else				/* OLDAPI_Py_UNICODE_NARROW */
+#elif defined(OLDAPI_Py_UNICODE_WIDE)
     unistr_KIND(kind, unistr->str, unichar_t, unilen);
 
     if ((kind == PyUnicode_1BYTE_KIND &&
@@ -275,6 +502,58 @@ unicode_FromCstruct(unistr_t * unistr)
 	ret = PyUnicode_FromKindAndData(kind, ucs, unilen);
 	PyMem_Free(ucs);
     }
+#else				/* OLDAPI_Py_UNICODE_NARROW */
+    /*
+     * Characters are copied into the narrowest object at once.  Object is
+     * widened only when a character not fitting in it is found, so that
+     * result is always in canonical form and, in most cases, characters
+     * are read only once.
+     */
+    str = unistr->str;
+    maxchar = 0x7F;
+    ret = NULL;
+    i = 0;
+    while (1) {
+	if ((obj = PyUnicode_New(unilen, (Py_UCS4) maxchar)) == NULL) {
+	    Py_XDECREF(ret);
+	    return NULL;
+	}
+	if (ret != NULL) {
+	    if (PyUnicode_CopyCharacters(obj, 0, ret, 0, i) < 0) {
+		Py_DECREF(obj);
+		Py_DECREF(ret);
+		return NULL;
+	    }
+	    Py_DECREF(ret);
+	}
+	ret = obj;
+
+	kind = PyUnicode_KIND(ret);
+	ucs = PyUnicode_DATA(ret);
+	if (kind == PyUnicode_1BYTE_KIND)
+	    i += ucs1_narrow((Py_UCS1 *) ucs + i, str + i, unilen - i,
+			     maxchar);
+	else if (kind == PyUnicode_2BYTE_KIND)
+	    for (; i < unilen && str[i] <= maxchar; i++)
+		((Py_UCS2 *) ucs)[i] = (Py_UCS2) str[i];
+	else
+	    for (; i < unilen && str[i] <= maxchar; i++)
+		((Py_UCS4 *) ucs)[i] = (Py_UCS4) str[i];
+	if (i == unilen)
+	    break;
+
+	if (str[i] < 0x100)
+	    maxchar = 0xFF;
+	else if (str[i] < 0x10000)
+	    maxchar = 0xFFFF;
+	else if (str[i] <= 0x10FFFF)
+	    maxchar = 0x10FFFF;
+	else {
+	    Py_DECREF(ret);
+	    PyErr_SetString(PyExc_ValueError, "character out of range.");
+	    return NULL;
+	}
+    }
 #endif				/* OLDAPI_Py_UNICODE_NARROW */
 
     return ret;
@@ -303,6 +582,9 @@ LineBreak_AsCstruct(PyObject * pyobj)
     return NULL;
 }
 
+static double sizing_UAX11_TABS(linebreak_t *, double, gcstring_t *,
+				gcstring_t *, gcstring_t *);
+
 /**
  * Convert linebreak object to LineBreakObject.
  */
@@ -314,9 +596,29 @@ LineBreak_FromCstruct(PyTypeObject * type, linebreak_t * lb)
     if ((self = type->tp_alloc(type, 0)) == NULL)
 	return NULL;
     LineBreak_AS_CSTRUCT(self) = lb;
+    if (lb != NULL && lb->sizing_func == sizing_UAX11_TABS)
+	((LineBreakObject *) self)->tabsize =
+	    PyFloat_AS_DOUBLE((PyObject *) lb->sizing_data);
+    else
+	((LineBreakObject *) self)->tabsize = DEFAULT_TABSIZE;
     return self;
 }
 
+/*
+ * Check if LineBreak object may be modified, i.e. it is not frozen.
+ * If not, exception will be raised and -1 will be returned.
+ */
+static int
+LineBreak_CheckWritable(PyObject * self)
+{
+    if (FrozenLineBreak_Check(self)) {
+	PyErr_SetString(PyExc_TypeError,
+			"frozen LineBreak object is read-only");
+	return -1;
+    }
+    return 0;
+}
+
 /**
  * Convert GCStrObject to gcstring object.
  */
@@ -349,1309 +651,2979 @@ GCStr_FromCstruct(PyTypeObject * type, gcstring_t * gcstr)
 }
 
 /**
- * Convert Python object, Unicode string or GCStrObject to
- * grapheme cluster string.
- * If error occurred, exception will be raised and NULL will be returned.
- * @note if pyobj was GCStrObject, returned object will be original
- * object (not a copy of it).  Otherwise, _new_ object will be returned.
+ * Let view be empty string of linebreak object lb, held by view itself.
+ * @note This function never fails.
  */
-
-static gcstring_t *
-genericstr_ToCstruct(PyObject * pyobj, linebreak_t * lb)
+static void
+GCStr_Empty(PyObject * self, linebreak_t * lb)
 {
-    unistr_t unistr = { NULL, 0 };
-    gcstring_t *gcstr;
-
-    if (pyobj == NULL)
-	return NULL;
-    if (GCStr_Check(pyobj))
-	return GCStr_AS_CSTRUCT(pyobj);
-    if (unicode_ToCstruct(&unistr, pyobj) == NULL)
-	return NULL;
-    if ((gcstr = gcstring_new(&unistr, lb)) == NULL) {
-	PyErr_SetFromErrno(PyExc_RuntimeError);
+    GCStrObject *obj = (GCStrObject *) self;
 
-	free(unistr.str);
-	return NULL;
-    }
-    return gcstr;
+    if (obj->obj == &obj->empty)
+	return;
+    memset(&obj->empty, 0, sizeof(gcstring_t));
+    if ((obj->empty.lbobj = lb) != NULL)
+	linebreak_incref(lb);
+    obj->obj = &obj->empty;
+    obj->view = 1;
 }
 
 /**
- * Convert Python object, Byte string, Unicode string or GCStrObject to 
- * NULL-termineted string.
- * If error occurred, exception will be raised and NULL will be returned.
- * @note string buffer must be free()'ed by caller.
+ * Make read-only view of grapheme cluster string owned by linebreak
+ * object lb.  Buffer is shared, not copied.  View must be released by
+ * GCStr_ReleaseView() before gcstr will be modified or freed.  If gcstr
+ * is NULL, view will be empty string.
  */
-
-static char *
-genericstr_ToString(PyObject * pyobj)
+static PyObject *
+GCStr_View(PyTypeObject * type, linebreak_t * lb, gcstring_t * gcstr)
 {
-    PyObject *pystr;
-    char *ret;
+    PyObject *self;
 
-    if (pyobj == NULL)
+    if ((self = GCStr_FromCstruct(type, gcstr)) == NULL)
 	return NULL;
-    else if (PyBytes_Check(pyobj)) {
-	if ((ret = strdup(PyBytes_AsString(pyobj))) == NULL) {
-	    PyErr_SetFromErrno(PyExc_RuntimeError);
-	    return NULL;
-	}
-    } else if (PyUnicode_Check(pyobj)) {
-	if ((pystr = PyUnicode_AsEncodedString(pyobj, NULL, NULL)) == NULL)
-	    return NULL;
-	if ((ret = strdup(PyBytes_AsString(pystr))) == NULL) {
-	    PyErr_SetFromErrno(PyExc_RuntimeError);
+    ((GCStrObject *) self)->view = 1;
+    if (gcstr == NULL)
+	GCStr_Empty(self, lb);
+    return self;
+}
 
-	    Py_DECREF(pystr);
-	    return NULL;
-	}
-	Py_DECREF(pystr);
-    } else {
-	if ((pyobj = PyObject_Unicode(pyobj)) == NULL)
-	    return NULL;
-	if ((pystr = PyUnicode_AsEncodedString(pyobj, NULL, NULL)) == NULL) {
-	    Py_DECREF(pyobj);
-	    return NULL;
-	}
-	Py_DECREF(pyobj);
-	if ((ret = strdup(PyBytes_AsString(pystr))) == NULL) {
-	    PyErr_SetFromErrno(PyExc_RuntimeError);
+/**
+ * Let view have its own copy of grapheme cluster string.  This must be
+ * called before GCStr object will be modified.
+ */
+static int
+GCStr_Own(PyObject * self)
+{
+    GCStrObject *obj = (GCStrObject *) self;
+    gcstring_t *gcstr;
 
-	    Py_DECREF(pystr);
-	    return NULL;
-	}
-	Py_DECREF(pystr);
+    if (!obj->view)
+	return 0;
+    if ((gcstr = gcstring_copy(obj->obj)) == NULL) {
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+	return -1;
     }
-    return ret;
+    if (obj->obj == &obj->empty && obj->empty.lbobj != NULL)
+	linebreak_destroy(obj->empty.lbobj);
+    obj->obj = gcstr;
+    obj->view = 0;
+    return 0;
 }
 
 /**
- * Convert Python object, Integer, Byte string, Unicode string or
- * GCStrObject to UCS scalar value.
- * If error occurred, exception will be raised and -1 will be returned.
+ * Release a reference to view.  If view is still referred by others, it
+ * is copied.
+ * If error occurred, exception will be raised, view will be emptied and
+ * -1 will be returned.
  */
-
-static unichar_t
-strOrInt_ToUCS(PyObject *pyobj)
+static int
+GCStr_ReleaseView(PyObject * self)
 {
-    PyObject *pystr;
-    unichar_t c;
-    int kind;
+    int ret = 0;
 
-    if (PyInt_Check(pyobj))
-	c = (unichar_t) PyInt_AsLong(pyobj);
-    else if (PyLong_Check(pyobj))
-	c = (unichar_t) PyLong_AsLong(pyobj);
-    else {
-	if (PyUnicode_Check(pyobj))
-	    pystr = pyobj;
-	else if ((pystr = PyObject_Unicode(pyobj)) == NULL)
-	    return (unichar_t)(-1);
+    if (1 < Py_REFCNT(self) && GCStr_Own(self) != 0) {
+	GCStr_Empty(self, GCStr_AS_CSTRUCT(self)->lbobj);
+	ret = -1;
+    }
+    Py_DECREF(self);
+    return ret;
+}
 
-	if (PyUnicode_READY(pystr) != 0) {
-	    if (! PyUnicode_Check(pyobj)) {
-		Py_DECREF(pystr);
-	    }
-	    return (unichar_t)(-1);
-	}
-	if (PyUnicode_GET_LENGTH(pystr) == 0) {
-	    PyErr_SetString(PyExc_ValueError,
-			    "empty string must not be a key");
+/*
+ * Printable ASCII characters (U+0020 - U+007E) have Grapheme_Cluster_Break
+ * property Other, so a break is always between two of them.  Inside a long
+ * run of them, each character is a grapheme cluster by itself and its record
+ * is copied from the record made for it in advance, instead of segmenting
+ * run character by character.  Characters at edges of runs are left to
+ * gcstring_new(), as they may be joined with neighbors.
+ */
+#define GCSTR_BULK_MINLEN (256)
+#define GCSTR_BULK_MINRUN (16)
 
-	    if (! PyUnicode_Check(pyobj)) {
-		Py_DECREF(pystr);
-	    }
-	    return (unichar_t)(-1);
-	}
-	kind = PyUnicode_KIND(pystr);
-	if (kind == PyUnicode_1BYTE_KIND)
-	    c = (unichar_t) *((Py_UCS1 *) PyUnicode_DATA(pystr));
-	else if (kind == PyUnicode_2BYTE_KIND)
-	    c = (unichar_t) *((Py_UCS2 *) PyUnicode_DATA(pystr));
-	else if (kind == PyUnicode_4BYTE_KIND)
-	    c = (unichar_t) *((Py_UCS4 *) PyUnicode_DATA(pystr));
-	else {
-	    PyErr_SetString(PyExc_SystemError, "invalid kind.");
+#define is_printable_ascii(c) (0x20 <= (c) && (c) <= 0x7E)
 
-	    if (! PyUnicode_Check(pyobj)) {
-		Py_DECREF(pystr);
-	    }
-	    return (unichar_t)(-1);
-	}
-#ifdef OLDAPI_Py_UNICODE_NARROW
-	/* FIXME: Add surrogate pair support. */
-#endif				/* OLDAPI_Py_UNICODE_NARROW */
+#ifdef SIMD_SSE2
+static size_t
+ascii_run_sse2(const unichar_t * src, size_t len)
+{
+    const __m128i lo = _mm_set1_epi32(0x1F);
+    const __m128i hi = _mm_set1_epi32(0x7F);
+    __m128i a, b, c, d;
+    size_t i;
 
-	if (! PyUnicode_Check(pyobj)) {
-	    Py_DECREF(pystr);
-	}
+#define _printable_sse2(v) \
+    _mm_and_si128(_mm_cmpgt_epi32((v), lo), _mm_cmplt_epi32((v), hi))
+
+    for (i = 0; i + 16 <= len; i += 16) {
+	a = _mm_loadu_si128((const __m128i *) (src + i));
+	b = _mm_loadu_si128((const __m128i *) (src + i + 4));
+	c = _mm_loadu_si128((const __m128i *) (src + i + 8));
+	d = _mm_loadu_si128((const __m128i *) (src + i + 12));
+	if (_mm_movemask_epi8(_mm_and_si128(
+		_mm_and_si128(_printable_sse2(a), _printable_sse2(b)),
+		_mm_and_si128(_printable_sse2(c), _printable_sse2(d))))
+	    != 0xFFFF)
+	    break;
     }
-    return c;
+    return i;
+
+#undef _printable_sse2
 }
+#endif				/* SIMD_SSE2 */
 
-/***
- *** Other utilities
- ***/
+#ifdef SIMD_AVX2
+__attribute__ ((target("avx2")))
+static size_t
+ascii_run_avx2(const unichar_t * src, size_t len)
+{
+    const __m256i lo = _mm256_set1_epi32(0x1F);
+    const __m256i hi = _mm256_set1_epi32(0x7F);
+    __m256i a, b, c, d;
+    size_t i;
 
-/*
- * Do regex match once then returns offset and length.
+#define _printable_avx2(v) \
+    _mm256_and_si256(_mm256_cmpgt_epi32((v), lo), _mm256_cmpgt_epi32(hi, (v)))
+
+    for (i = 0; i + 32 <= len; i += 32) {
+	a = _mm256_loadu_si256((const __m256i *) (src + i));
+	b = _mm256_loadu_si256((const __m256i *) (src + i + 8));
+	c = _mm256_loadu_si256((const __m256i *) (src + i + 16));
+	d = _mm256_loadu_si256((const __m256i *) (src + i + 24));
+	if (_mm256_movemask_epi8(_mm256_and_si256(
+		_mm256_and_si256(_printable_avx2(a), _printable_avx2(b)),
+		_mm256_and_si256(_printable_avx2(c), _printable_avx2(d))))
+	    != -1)
+	    break;
+    }
+    return i;
+
+#undef _printable_avx2
+}
+#endif				/* SIMD_AVX2 */
+
+/*
+ * Return length of leading run of printable ASCII characters in src.
  */
-static void
-do_re_search_once(PyObject * rx, unistr_t * str, unistr_t * text)
+static size_t
+ascii_run(const unichar_t * src, size_t len)
+{
+    size_t i = 0;
+#ifdef SIMD_AVX2
+    if (cpu_has_avx2())
+	i = ascii_run_avx2(src, len);
+#endif				/* SIMD_AVX2 */
+#ifdef SIMD_SSE2
+    i += ascii_run_sse2(src + i, len - i);
+#endif				/* SIMD_SSE2 */
+    for (; i < len && is_printable_ascii(src[i]); i++);
+    return i;
+}
+
+/*
+ * Check if grapheme cluster break property of any printable ASCII
+ * characters is tailored.
+ */
+static int
+linebreak_tailors_ascii_gcb(linebreak_t * lb)
 {
-    PyObject *strobj, *matchobj, *func_search, *args, *pyobj;
-    Py_ssize_t pos, endpos, start, end;
-#ifdef OLDAPI_Py_UNICODE_NARROW
     size_t i;
-#endif				/* OLDAPI_Py_UNICODE_NARROW */
 
-#ifdef OLDAPI_Py_UNICODE_NARROW
-    start = str->str - text->str;
-    end = start + str->len;
-    for (i = 0, pos = 0; i < start; i++, pos++)
-	if (0x10000 <= text->str[i])
-	    pos++;
-    for (endpos = pos; i < end; i++, endpos++)
-	if (0x10000 <= text->str[i])
-	    endpos++;
-#else				/* OLDAPI_Py_UNICODE_NARROW */
-    pos = str->str - text->str;
-    endpos = pos + str->len;
-#endif				/* OLDAPI_Py_UNICODE_NARROW */
+    for (i = 0; i < lb->mapsiz; i++)
+	if (lb->map[i].beg <= 0x7E && 0x20 <= lb->map[i].end &&
+	    lb->map[i].gcb != PROP_UNKNOWN)
+	    return 1;
+    return 0;
+}
 
-    if ((strobj = unicode_FromCstruct(text)) == NULL) {
-	str->str = NULL;
-	return;
-    }
-    if ((func_search = PyObject_GetAttrString(rx, "search")) == NULL) {
-	Py_DECREF(strobj);
-	str->str = NULL;
-	return;
-    }
-    if (!PyCallable_Check(func_search)) {
-	PyErr_SetString(PyExc_ValueError, "object is not callable");
+/*
+ * Segment str[beg, end) and append its records to gcstr, starting at *np.
+ * If error occurred, errno will be set and -1 will be returned.
+ */
+static int
+gcchars_segment(unichar_t * str, size_t beg, size_t end, linebreak_t * lb,
+		gcchar_t * gcstr, size_t * np)
+{
+    unistr_t sub;
+    gcstring_t *part;
+    size_t i;
 
-	Py_DECREF(strobj);
-	Py_DECREF(func_search);
-	str->str = NULL;
-	return;
-    }
-    if ((args = Py_BuildValue("(O" ARG_FORMAT_SSIZE_T ARG_FORMAT_SSIZE_T ")",
-			      strobj, pos, endpos)) == NULL) {
-	Py_DECREF(func_search);
-	return;
-    }
-    matchobj = PyObject_CallObject(func_search, args);
-    Py_DECREF(args);
-    Py_DECREF(func_search);
-    if (matchobj == NULL) {
-	str->str = NULL;
-	return;
+    if (beg == end)
+	return 0;
+    sub.str = str + beg;
+    sub.len = end - beg;
+    if ((part = gcstring_newcopy(&sub, lb)) == NULL)
+	return -1;
+    for (i = 0; i < part->gclen; i++, (*np)++) {
+	gcstr[*np] = part->gcstr[i];
+	gcstr[*np].idx += beg;
     }
-
-    if (matchobj != Py_None) {
-	if ((pyobj = PyObject_CallMethod(matchobj, "start", NULL)) == NULL) {
-	    Py_DECREF(matchobj);
-	    str->str = NULL;
-	    return;
-	}
-	start = PyLong_AsLong(pyobj);
-	Py_DECREF(pyobj);
-
-	if ((pyobj = PyObject_CallMethod(matchobj, "end", NULL)) == NULL) {
-	    Py_DECREF(matchobj);
-	    str->str = NULL;
-	    return;
-	}
-	end = PyLong_AsLong(pyobj);
-	Py_DECREF(pyobj);
-
-#ifdef OLDAPI_Py_UNICODE_NARROW
-	for (i = 0, pos = 0; i < start; i++, pos++)
-	    if (0x10000 <= text->str[pos])
-		i++;
-	for (endpos = pos; i < end; i++, endpos++)
-	    if (0x10000 <= text->str[endpos])
-		i++;
-	str->str = text->str + pos;
-	str->len = endpos - pos;
-#else				/* OLDAPI_Py_UNICODE_NARROW */
-	str->str = text->str + start;
-	str->len = end - start;
-#endif				/* OLDAPI_Py_UNICODE_NARROW */
-    } else
-	str->str = NULL;
-    Py_DECREF(matchobj);
+    gcstring_destroy(part);
+    return 0;
 }
 
-/***
- *** Callbacks for linebreak library.  For more details see Sombok
- *** library documentations.
- ***/
-
 /*
- * Increment/decrement reference count
+ * Make records of printable ASCII characters by segmenting them with lb.
+ * If they were not segmented into single characters, errno will be 0 and
+ * -1 will be returned.
+ * If error occurred, errno will be set and -1 will be returned.
  */
-static void
-ref_func(void * obj, int datatype, int d)
+static int
+gcchars_template(linebreak_t * lb, gcchar_t * tmpl)
 {
-    if (0 < d) {
-	Py_INCREF((PyObject *)obj);
-    } else if (d < 0) {
-	Py_DECREF((PyObject *)obj);
+    unichar_t buf[0x5F];
+    unistr_t unistr = { buf, 0x5F };
+    gcstring_t *gcstr;
+    size_t i;
+
+    for (i = 0; i < 0x5F; i++)
+	buf[i] = (unichar_t) (0x20 + i);
+    if ((gcstr = gcstring_newcopy(&unistr, lb)) == NULL)
+	return -1;
+    if (gcstr->gclen != 0x5F) {
+	gcstring_destroy(gcstr);
+	errno = 0;
+	return -1;
+    }
+    for (i = 0; i < 0x5F; i++) {
+	if (gcstr->gcstr[i].len != 1) {
+	    gcstring_destroy(gcstr);
+	    errno = 0;
+	    return -1;
+	}
+	tmpl[i] = gcstr->gcstr[i];
     }
+    gcstring_destroy(gcstr);
+    return 0;
 }
 
 /*
- * Call preprocessing function
- * @note Python callback may return list of broken text or single text.
+ * Make records of grapheme clusters in unistr, filling records inside long
+ * runs of printable ASCII characters directly.
+ * If unistr had no such runs, errno will be 0 and NULL will be returned.
+ * If error occurred, errno will be set and NULL will be returned.
  */
-static gcstring_t *
-prep_func(linebreak_t * lb, void *data, unistr_t * str, unistr_t * text)
+static gcchar_t *
+gcchars_bulk(unistr_t * unistr, linebreak_t * lb, size_t * gclenp)
 {
-    PyObject *rx = NULL, *func = NULL, *pyret, *pyobj, *args;
-    int count, i, j;
-    gcstring_t *gcstr, *ret;
-
-    /* Pass I */
+    unichar_t *str = unistr->str;
+    size_t len = unistr->len;
+    gcchar_t tmpl[0x5F], *ret = NULL, *r;
+    size_t i, j, run, beg, end, prev = 0, n = 0;
 
-    if (text != NULL) {
-	if ((rx = PyTuple_GetItem(data, 0)) == NULL) {
-	    lb->errnum = EINVAL;
-	    return NULL;
-	}
-	do_re_search_once(rx, str, text);
+    errno = 0;
+    if (len < GCSTR_BULK_MINLEN || linebreak_tailors_ascii_gcb(lb))
 	return NULL;
-    }
 
-    /* Pass II */
+    for (i = 0; i < len; i += run) {
+	if ((run = ascii_run(str + i, len - i)) == 0) {
+	    run = 1;
+	    continue;
+	}
+	beg = (i == 0) ? 0 : i + 1;
+	end = (i + run == len) ? len : i + run - 1;
+	if (end < beg + GCSTR_BULK_MINRUN)
+	    continue;
 
-    if ((func = PyTuple_GetItem(data, 1)) == NULL) {
-	if ((ret = gcstring_newcopy(str, lb)) == NULL) {
-	    lb->errnum = errno ? errno : ENOMEM;
+	if (ret == NULL) {
+	    if (gcchars_template(lb, tmpl) != 0)
+		return NULL;
+	    if ((ret = malloc(sizeof(gcchar_t) * len)) == NULL)
+		return NULL;
+	}
+	if (gcchars_segment(str, prev, beg, lb, ret, &n) != 0) {
+	    free(ret);
 	    return NULL;
 	}
-	return ret;
+	for (j = beg; j < end; j++, n++) {
+	    ret[n] = tmpl[str[j] - 0x20];
+	    ret[n].idx = j;
+	}
+	prev = end;
     }
-
-    linebreak_incref(lb);	/* prevent destruction */
-    if ((args = Py_BuildValue("(OO)",
-			      LineBreak_FromCstruct(STASH_TYPE(lb), lb),
-			      unicode_FromCstruct(str))) == NULL) {
-	lb->errnum = LINEBREAK_EEXTN;
+    if (ret == NULL)
 	return NULL;
-    }
-    pyret = PyObject_CallObject(func, args);
-    Py_DECREF(args);
-    if (PyErr_Occurred()) {
-	if (!lb->errnum)
-	    lb->errnum = LINEBREAK_EEXTN;
+    if (gcchars_segment(str, prev, len, lb, ret, &n) != 0) {
+	free(ret);
 	return NULL;
     }
-    if (pyret == NULL)
-	return NULL;
-
-    if (PyList_Check(pyret)) {
-	if ((ret = gcstring_new(NULL, lb)) == NULL)
-	    return (lb->errnum = errno ? errno : ENOMEM), NULL;
 
-	count = PyList_Size(pyret);
-	for (i = 0; i < count; i++) {
-	    pyobj = PyList_GetItem(pyret, i);	/* borrowed ref. */
-	    if (pyobj == Py_None)
-		continue;
-	    else if (GCStr_Check(pyobj))
-		gcstr = gcstring_copy(GCStr_AS_CSTRUCT(pyobj));
-	    else
-		gcstr = genericstr_ToCstruct(pyobj, lb);
-	    if (gcstr == NULL) {
-		if (!lb->errnum)
-		    lb->errnum = errno ? errno : LINEBREAK_EEXTN;
+    if ((r = realloc(ret, sizeof(gcchar_t) * n)) != NULL)
+	ret = r;
+    *gclenp = n;
+    return ret;
+}
 
-		Py_DECREF(pyret);
-		return NULL;
-	    }
+/*
+ * Create grapheme cluster string as gcstring_new() (copy is false) or
+ * gcstring_newcopy() (copy is true) do, filling records of long runs of
+ * printable ASCII characters directly.
+ * If error occurred, errno will be set and NULL will be returned.
+ * @note if copy is false, buffer of unistr will be taken over on success.
+ */
+static gcstring_t *
+gcstring_new_bulk(unistr_t * unistr, linebreak_t * lb, int copy)
+{
+    linebreak_t *newlb = NULL;
+    gcstring_t *ret;
+    gcchar_t *gcstr;
+    size_t gclen;
 
-	    for (j = 0; j < gcstr->gclen; j++) {
-		if (gcstr->gcstr[j].flag &
-		    (LINEBREAK_FLAG_ALLOW_BEFORE |
-		     LINEBREAK_FLAG_PROHIBIT_BEFORE))
-		    continue;
-		if (0 < i && j == 0)
-		    gcstr->gcstr[j].flag |= LINEBREAK_FLAG_ALLOW_BEFORE;
-		else if (0 < j)
-		    gcstr->gcstr[j].flag |= LINEBREAK_FLAG_PROHIBIT_BEFORE;
-	    }
+    if (lb == NULL) {
+	if ((newlb = linebreak_new(NULL)) == NULL)
+	    return NULL;
+	lb = newlb;
+    }
 
-	    gcstring_append(ret, gcstr);
-	    gcstring_destroy(gcstr);
-	}
-	Py_DECREF(pyret);
+    if ((gcstr = gcchars_bulk(unistr, lb, &gclen)) == NULL) {
+	if (errno)
+	    ret = NULL;
+	else if (copy)
+	    ret = gcstring_newcopy(unistr, lb);
+	else
+	    ret = gcstring_new(unistr, lb);
+	if (newlb != NULL)
+	    linebreak_destroy(newlb);
 	return ret;
     }
 
-    if (pyret == Py_None) {
-	Py_DECREF(pyret);
+    if ((ret = malloc(sizeof(gcstring_t))) == NULL) {
+	free(gcstr);
+	if (newlb != NULL)
+	    linebreak_destroy(newlb);
 	return NULL;
     }
-
-    if (GCStr_Check(pyret))
-	ret = gcstring_copy(GCStr_AS_CSTRUCT(pyret));
-    else
-	ret = genericstr_ToCstruct(pyret, lb);
-    if (ret == NULL) {
-	if (!lb->errnum)
-	    lb->errnum = LINEBREAK_EEXTN;
-
-	Py_DECREF(pyret);
+    memset(ret, 0, sizeof(gcstring_t));
+    if (!copy)
+	ret->str = unistr->str;
+    else if ((ret->str = malloc(sizeof(unichar_t) * unistr->len)) != NULL)
+	memcpy(ret->str, unistr->str, sizeof(unichar_t) * unistr->len);
+    else {
+	free(ret);
+	free(gcstr);
+	if (newlb != NULL)
+	    linebreak_destroy(newlb);
 	return NULL;
     }
-    Py_DECREF(pyret);
-
-    for (j = 0; j < ret->gclen; j++) {
-	if (ret->gcstr[j].flag &
-	    (LINEBREAK_FLAG_ALLOW_BEFORE | LINEBREAK_FLAG_PROHIBIT_BEFORE))
-	    continue;
-	if (0 < j)
-	    ret->gcstr[j].flag |= LINEBREAK_FLAG_PROHIBIT_BEFORE;
-    }
-
+    ret->len = unistr->len;
+    ret->gcstr = gcstr;
+    ret->gclen = gclen;
+    ret->pos = 0;
+    /* New linebreak object is owned by result. */
+    ret->lbobj = (newlb != NULL) ? newlb : linebreak_incref(lb);
     return ret;
 }
 
-/*
- * Call format function
+/**
+ * Convert Python object, Unicode string or GCStrObject to
+ * grapheme cluster string.
+ * If error occurred, exception will be raised and NULL will be returned.
+ * @note if pyobj was GCStrObject, returned object will be original
+ * object (not a copy of it).  Otherwise, _new_ object will be returned.
  */
-static char *linebreak_states[] = {
-    NULL, "sot", "sop", "sol", "", "eol", "eop", "eot", NULL
-};
+
 static gcstring_t *
-format_func(linebreak_t * lb, linebreak_state_t action, gcstring_t * str)
+genericstr_ToCstruct(PyObject * pyobj, linebreak_t * lb)
 {
-    PyObject *func, *args, *pyret;
-    char *actionstr;
+    unistr_t unistr = { NULL, 0 };
+    PyObject *owner;
     gcstring_t *gcstr;
 
-    func = (PyObject *) lb->format_data;
-    if (func == NULL)
+    if (pyobj == NULL)
 	return NULL;
-
-    if (action <= LINEBREAK_STATE_NONE || LINEBREAK_STATE_MAX <= action)
+    if (GCStr_Check(pyobj))
+	return GCStr_AS_CSTRUCT(pyobj);
+    if (unicode_BorrowCstruct(&unistr, pyobj, &owner) == NULL)
 	return NULL;
-    actionstr = linebreak_states[(size_t) action];
 
-    linebreak_incref(lb);	/* prevent destruction */
-    if ((args = Py_BuildValue("(OsO)",
-			      LineBreak_FromCstruct(STASH_TYPE(lb), lb),
-			      actionstr,
-			      GCStr_FromCstruct(STASH_GCSTRTYPE(lb),
-						gcstring_copy(str))))
-	== NULL) {
-	lb->errnum = LINEBREAK_EEXTN;
+    /* Borrowed buffer is copied once; private buffer is taken over. */
+    if (owner != NULL) {
+	gcstr = gcstring_new_bulk(&unistr, lb, 1);
+	unicode_ReleaseCstruct(&unistr, owner);
+	if (gcstr == NULL) {
+	    PyErr_SetFromErrno(PyExc_RuntimeError);
+	    return NULL;
+	}
+    } else if ((gcstr = gcstring_new_bulk(&unistr, lb, 0)) == NULL) {
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+
+	free(unistr.str);
 	return NULL;
     }
-    pyret = PyObject_CallObject(func, args);
-    Py_DECREF(args);
+    return gcstr;
+}
 
-    if (PyErr_Occurred()) {
-	if (!lb->errnum)
-	    lb->errnum = LINEBREAK_EEXTN;
-	if (pyret != NULL) {
-	    Py_DECREF(pyret);
-	}
-	return NULL;
-    }
-    if (pyret == NULL)
-	return NULL;
+/**
+ * Convert Python object, Byte string, Unicode string or GCStrObject to 
+ * NULL-termineted string.
+ * If error occurred, exception will be raised and NULL will be returned.
+ * @note string buffer must be free()'ed by caller.
+ */
 
-    if (pyret == Py_None) {
-	Py_DECREF(pyret);
-	return NULL;
-    }
+static char *
+genericstr_ToString(PyObject * pyobj)
+{
+    PyObject *pystr;
+    char *ret;
 
-    if (GCStr_Check(pyret))
-	gcstr = gcstring_copy(GCStr_AS_CSTRUCT(pyret));
-    else if ((gcstr = genericstr_ToCstruct(pyret, lb)) == NULL) {
-	if (!lb->errnum)
-	    lb->errnum = errno ? errno : ENOMEM;
-	PyErr_SetFromErrno(PyExc_RuntimeError);
-	Py_DECREF(pyret);
+    if (pyobj == NULL)
 	return NULL;
+    else if (PyBytes_Check(pyobj)) {
+	if ((ret = strdup(PyBytes_AsString(pyobj))) == NULL) {
+	    PyErr_SetFromErrno(PyExc_RuntimeError);
+	    return NULL;
+	}
+    } else if (PyUnicode_Check(pyobj)) {
+	if ((pystr = PyUnicode_AsEncodedString(pyobj, NULL, NULL)) == NULL)
+	    return NULL;
+	if ((ret = strdup(PyBytes_AsString(pystr))) == NULL) {
+	    PyErr_SetFromErrno(PyExc_RuntimeError);
+
+	    Py_DECREF(pystr);
+	    return NULL;
+	}
+	Py_DECREF(pystr);
+    } else {
+	if ((pyobj = PyObject_Unicode(pyobj)) == NULL)
+	    return NULL;
+	if ((pystr = PyUnicode_AsEncodedString(pyobj, NULL, NULL)) == NULL) {
+	    Py_DECREF(pyobj);
+	    return NULL;
+	}
+	Py_DECREF(pyobj);
+	if ((ret = strdup(PyBytes_AsString(pystr))) == NULL) {
+	    PyErr_SetFromErrno(PyExc_RuntimeError);
+
+	    Py_DECREF(pystr);
+	    return NULL;
+	}
+	Py_DECREF(pystr);
     }
-    Py_DECREF(pyret);
-    return gcstr;
+    return ret;
 }
 
-/*
- * Call sizing function
+/**
+ * Convert Python object, Integer, Byte string, Unicode string or
+ * GCStrObject to UCS scalar value.
+ * If error occurred, exception will be raised and -1 will be returned.
  */
-static double
-sizing_func(linebreak_t * lb, double len,
-	    gcstring_t * pre, gcstring_t * spc, gcstring_t * str)
+
+static unichar_t
+strOrInt_ToUCS(PyObject *pyobj)
 {
-    PyObject *func, *args, *pyret;
-    PyTypeObject *gcstr_type;
-    double ret;
+    PyObject *pystr;
+    unichar_t c;
+    int kind;
 
-    func = (PyObject *) lb->sizing_data;
-    if (func == NULL)
-	return -1.0;
+    if (PyInt_Check(pyobj))
+	c = (unichar_t) PyInt_AsLong(pyobj);
+    else if (PyLong_Check(pyobj))
+	c = (unichar_t) PyLong_AsLong(pyobj);
+    else {
+	if (PyUnicode_Check(pyobj))
+	    pystr = pyobj;
+	else if ((pystr = PyObject_Unicode(pyobj)) == NULL)
+	    return (unichar_t)(-1);
 
-    gcstr_type = STASH_GCSTRTYPE(lb);
-    linebreak_incref(lb);	/* prevent destruction. */
-    if ((args = Py_BuildValue("(OdOOO)",
-			      LineBreak_FromCstruct(STASH_TYPE(lb), lb),
-			      len,
-			      GCStr_FromCstruct(gcstr_type,
-						gcstring_copy(pre)),
-			      GCStr_FromCstruct(gcstr_type,
-						gcstring_copy(spc)),
-			      GCStr_FromCstruct(gcstr_type,
-						gcstring_copy(str))))
-	== NULL) {
-	lb->errnum = LINEBREAK_EEXTN;
-	return -1.0;
-    }
-    pyret = PyObject_CallObject(func, args);
-    Py_DECREF(args);
+	if (PyUnicode_READY(pystr) != 0) {
+	    if (! PyUnicode_Check(pyobj)) {
+		Py_DECREF(pystr);
+	    }
+	    return (unichar_t)(-1);
+	}
+	if (PyUnicode_GET_LENGTH(pystr) == 0) {
+	    PyErr_SetString(PyExc_ValueError,
+			    "empty string must not be a key");
 
-    if (PyErr_Occurred()) {
-	if (!lb->errnum)
-	    lb->errnum = LINEBREAK_EEXTN;
-	if (pyret != NULL) {
-	    Py_DECREF(pyret);
+	    if (! PyUnicode_Check(pyobj)) {
+		Py_DECREF(pystr);
+	    }
+	    return (unichar_t)(-1);
 	}
-	return -1.0;
-    }
+	kind = PyUnicode_KIND(pystr);
+	if (kind == PyUnicode_1BYTE_KIND)
+	    c = (unichar_t) *((Py_UCS1 *) PyUnicode_DATA(pystr));
+	else if (kind == PyUnicode_2BYTE_KIND)
+	    c = (unichar_t) *((Py_UCS2 *) PyUnicode_DATA(pystr));
+	else if (kind == PyUnicode_4BYTE_KIND)
+	    c = (unichar_t) *((Py_UCS4 *) PyUnicode_DATA(pystr));
+	else {
+	    PyErr_SetString(PyExc_SystemError, "invalid kind.");
 
-    ret = PyFloat_AsDouble(pyret);
-    if (PyErr_Occurred()) {
-	if (!lb->errnum)
-	    lb->errnum = LINEBREAK_EEXTN;
-	Py_DECREF(pyret);
-	return -1.0;
-    }
-    Py_DECREF(pyret);
+	    if (! PyUnicode_Check(pyobj)) {
+		Py_DECREF(pystr);
+	    }
+	    return (unichar_t)(-1);
+	}
+#ifdef OLDAPI_Py_UNICODE_NARROW
+	/* FIXME: Add surrogate pair support. */
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
 
-    return ret;
+	if (! PyUnicode_Check(pyobj)) {
+	    Py_DECREF(pystr);
+	}
+    }
+    return c;
 }
 
+/***
+ *** Other utilities
+ ***/
+
 /*
- * Call urgent breaking function
+ * Context of breaking and regex search.
+ * LineBreak object calling breaking is passed to Python callbacks as is.
+ * Text given to Pass I of prep_func() is converted to Unicode object, and
+ * search method of each regex object is looked up, at most once per run of
+ * linebreak_break().  Contexts are stacked per thread so that recursive
+ * breaking by Python callbacks won't confuse them.
  */
-static gcstring_t *
-urgent_func(linebreak_t * lb, gcstring_t * str)
-{
-    PyObject *func, *args, *pyret, *pyobj;
-    size_t count, i;
-    gcstring_t *gcstr, *ret;
+typedef struct {
+    linebreak_t *lb;		/* linebreak object breaking text */
+    PyObject *owner;		/* LineBreak object calling it: borrowed */
+    unsigned long gen;		/* generation of current run */
+    unsigned long strgen;	/* generation strobj was built at */
+    unichar_t *str;		/* text strobj was built from */
+    size_t len;
+    PyObject *strobj;		/* text as Unicode object */
+    PyObject *searches;		/* { regex: bound search method } */
+    PyObject *prev;		/* outer context */
+} searchctx_t;
 
-    func = (PyObject *) lb->urgent_data;
-    if (func == NULL)
-	return NULL;
+static PyObject *searchctx_key;
 
-    linebreak_incref(lb);	/* prevent destruction. */
-    if ((args = Py_BuildValue("(OO)",
-			      LineBreak_FromCstruct(STASH_TYPE(lb), lb),
-			      GCStr_FromCstruct(STASH_GCSTRTYPE(lb),
-						gcstring_copy(str))))
-	== NULL) {
-	lb->errnum = LINEBREAK_EEXTN;
-	return NULL;
+/*
+ * Activate search context during breaking by lb.  owner is LineBreak
+ * object calling breaking, or NULL.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+searchctx_begin(searchctx_t * ctx, linebreak_t * lb, PyObject * owner)
+{
+    PyObject *tsdict, *pyobj;
+
+    ctx->lb = lb;
+    ctx->owner = owner;
+    ctx->gen = 0;
+    ctx->strgen = 0;
+    ctx->str = NULL;
+    ctx->len = 0;
+    ctx->strobj = NULL;
+    ctx->searches = NULL;
+    ctx->prev = NULL;
+
+    if ((tsdict = PyThreadState_GetDict()) == NULL) {
+	PyErr_SetString(PyExc_RuntimeError, "no current thread state");
+	return -1;
     }
-    pyret = PyObject_CallObject(func, args);
-    Py_DECREF(args);
-
-    if (PyErr_Occurred()) {
-	if (!lb->errnum)
-	    lb->errnum = LINEBREAK_EEXTN;
-	if (pyret != NULL) {
-	    Py_DECREF(pyret);
-	}
-	return NULL;
+    ctx->prev = PyDict_GetItem(tsdict, searchctx_key);	/* borrowed */
+    Py_XINCREF(ctx->prev);
+    if ((pyobj = PyLong_FromVoidPtr((void *) ctx)) == NULL) {
+	Py_XDECREF(ctx->prev);
+	return -1;
     }
-    if (pyret == NULL)
-	return NULL;
-
-    if (pyret == Py_None) {
-	Py_DECREF(pyret);
-	return NULL;
+    if (PyDict_SetItem(tsdict, searchctx_key, pyobj) != 0) {
+	Py_DECREF(pyobj);
+	Py_XDECREF(ctx->prev);
+	return -1;
     }
+    Py_DECREF(pyobj);
+    return 0;
+}
 
-    if (!PyList_Check(pyret)) {
-	if (GCStr_Check(pyret))
-	    ret = gcstring_copy(GCStr_AS_CSTRUCT(pyret));
-	else
-	    ret = genericstr_ToCstruct(pyret, lb);
-	Py_DECREF(pyret);
-	return ret;
-    }
+/*
+ * Deactivate search context and release cached objects.
+ * @note exception raised during breaking will be kept.
+ */
+static void
+searchctx_end(searchctx_t * ctx)
+{
+    PyObject *tsdict, *type, *value, *traceback;
 
-    ret = gcstring_new(NULL, lb);
-    count = PyList_Size(pyret);
-    for (i = 0; i < count; i++) {
-	pyobj = PyList_GetItem(pyret, i);	/* borrowed ref. */
-	if (pyobj == Py_None)
-	    continue;
-	else if (GCStr_Check(pyobj))
-	    gcstr = gcstring_copy(GCStr_AS_CSTRUCT(pyobj));
+    PyErr_Fetch(&type, &value, &traceback);
+    if ((tsdict = PyThreadState_GetDict()) != NULL) {
+	if (ctx->prev != NULL)
+	    PyDict_SetItem(tsdict, searchctx_key, ctx->prev);
 	else
-	    gcstr = genericstr_ToCstruct(pyobj, lb);
-	if (gcstr == NULL) {
-	    if (!lb->errnum)
-		lb->errnum = errno ? errno : LINEBREAK_EEXTN;
-
-	    Py_DECREF(pyret);
-	    return NULL;
-	}
-
-	if (gcstr->gclen)
-	    gcstr->gcstr[0].flag = LINEBREAK_FLAG_ALLOW_BEFORE;
-	gcstring_append(ret, gcstr);
-	gcstring_destroy(gcstr);
+	    PyDict_DelItem(tsdict, searchctx_key);
     }
+    PyErr_Clear();
+    PyErr_Restore(type, value, traceback);
 
-    Py_DECREF(pyret);
-    return ret;
+    Py_XDECREF(ctx->prev);
+    Py_XDECREF(ctx->strobj);
+    Py_XDECREF(ctx->searches);
 }
 
-/*** 
- *** Python module definitions
- ***/
-
-/**
- ** Exceptions
- **/
-
-static PyObject *LineBreakException;
+/*
+ * Get search context of current thread.  NULL will be returned if
+ * breaking is not in progress.
+ */
+static searchctx_t *
+searchctx_current(void)
+{
+    PyObject *tsdict, *pyobj;
 
-/**
- ** LineBreak class
- **/
+    if ((tsdict = PyThreadState_GetDict()) == NULL)
+	return NULL;
+    if ((pyobj = PyDict_GetItem(tsdict, searchctx_key)) == NULL)
+	return NULL;
+    return (searchctx_t *) PyLong_AsVoidPtr(pyobj);
+}
 
 /*
- * Constructor & Destructor
+ * Start next run of linebreak_break() or linebreak_break_partial() in
+ * context.  ctx may be NULL.
+ * @note Buffer of text may be freed by linebreak object and reused by
+ * another text of the same length at the next run, so cached text expires.
+ * This function itself never calls Python API.
  */
-
 static void
-LineBreak_dealloc(LineBreakObject * self)
+searchctx_next(searchctx_t * ctx)
 {
-    TDictObject * tdict;
-
-    /* remove linkage to tailoring dictionaries */
-    for (tdict = self->tdict; tdict != NULL; tdict = tdict->next)
-	tdict->lb = NULL;
-
-    linebreak_destroy(LineBreak_AS_CSTRUCT(self));
-    Py_TYPE(self)->tp_free(self);
-}
+    if (ctx != NULL)
+	ctx->gen++;
+}
 
+/*
+ * Get text as Unicode object, converting it only if it has not been cached
+ * during current run.
+ */
 static PyObject *
-LineBreak_subtype_new(PyTypeObject *, PyObject *, PyObject *);
+searchctx_text(searchctx_t * ctx, unistr_t * str, unistr_t * text)
+{
+    PyObject *strobj;
 
+    if (ctx == NULL)
+	return unicode_FromCstruct(text);
+
+    if (ctx->strobj == NULL || ctx->strgen != ctx->gen ||
+	ctx->str != text->str || ctx->len != text->len) {
+	if ((strobj = unicode_FromCstruct(text)) == NULL)
+	    return NULL;
+	Py_XDECREF(ctx->strobj);
+	ctx->strobj = strobj;
+	ctx->strgen = ctx->gen;
+	ctx->str = text->str;
+	ctx->len = text->len;
+    }
+    Py_INCREF(ctx->strobj);
+    return ctx->strobj;
+}
+
+/*
+ * Get search method bound to regex object.
+ */
 static PyObject *
-LineBreak_new(PyTypeObject * type, PyObject * args, PyObject * kwds)
+searchctx_search(searchctx_t * ctx, PyObject * rx)
 {
-    LineBreakObject *self;
-    PyObject *stash;
+    PyObject *func_search;
 
-    if (type != &LineBreak_Type)
-        return LineBreak_subtype_new(type, args, kwds);
+    if (ctx != NULL && ctx->searches != NULL &&
+	(func_search = PyDict_GetItem(ctx->searches, rx)) != NULL) {
+	Py_INCREF(func_search);
+	return func_search;
+    }
 
-    if ((self = (LineBreakObject *) type->tp_alloc(type, 0)) == NULL)
+    if ((func_search = PyObject_GetAttrString(rx, "search")) == NULL)
 	return NULL;
+    if (!PyCallable_Check(func_search)) {
+	PyErr_SetString(PyExc_ValueError, "object is not callable");
 
-    if ((self->obj = linebreak_new(ref_func)) == NULL) {
-	PyErr_SetFromErrno(PyExc_RuntimeError);
-	Py_DECREF(self);
+	Py_DECREF(func_search);
 	return NULL;
     }
 
-    /*
-     * stash is a tuple of
-     * (<dict>, <LineBreak type>, <GCStr type>, <Exception type>).
-     * <dict> is used by mapping methods.  Others are type of Python 
-     * objects used in the callback functions.
-     */
-    Py_INCREF(&LineBreak_Type);
-    Py_INCREF(&GCStr_Type);
-    Py_INCREF(LineBreakException);
-    if ((stash = Py_BuildValue("({}OOO)",
-			       (PyObject *)&LineBreak_Type,
-			       (PyObject *)&GCStr_Type,
-			       LineBreakException)) == NULL) {
-	Py_DECREF(self);
-	return NULL;
+    if (ctx != NULL) {
+	if (ctx->searches == NULL)
+	    ctx->searches = PyDict_New();
+	/* Unhashable regex objects just won't be cached. */
+	if (ctx->searches == NULL ||
+	    PyDict_SetItem(ctx->searches, rx, func_search) != 0)
+	    PyErr_Clear();
     }
-
-    linebreak_set_stash(self->obj, stash);
-    Py_DECREF(stash);		/* fixup */
-
-    /* tailoring dictionary */
-    self->tdict = NULL;
-
-    return (PyObject *) self;
+    return func_search;
 }
 
-static PyObject *
-LineBreak_subtype_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+/*
+ * Do regex match once then returns offset and length.
+ */
+static void
+do_re_search_once(searchctx_t * ctx, PyObject * rx, unistr_t * str,
+		  unistr_t * text)
 {
-    PyObject *tmp, *newobj;
+    PyObject *strobj, *matchobj, *func_search, *args, *pyobj;
+    Py_ssize_t pos, endpos, start, end;
+#ifdef OLDAPI_Py_UNICODE_NARROW
+    size_t i;
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
 
-    assert(PyType_IsSubtype(type, &LineBreak_Type));
-    if ((tmp = LineBreak_new(&LineBreak_Type, args, kwds)) == NULL)
-	return NULL;
-    assert(LineBreak_CheckExact(tmp));
-    if ((newobj = type->tp_alloc(type, 0)) == NULL) {
-	Py_DECREF(tmp);
-	return NULL;
+#ifdef OLDAPI_Py_UNICODE_NARROW
+    start = str->str - text->str;
+    end = start + str->len;
+    for (i = 0, pos = 0; i < start; i++, pos++)
+	if (0x10000 <= text->str[i])
+	    pos++;
+    for (endpos = pos; i < end; i++, endpos++)
+	if (0x10000 <= text->str[i])
+	    endpos++;
+#else				/* OLDAPI_Py_UNICODE_NARROW */
+    pos = str->str - text->str;
+    endpos = pos + str->len;
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
+
+    if ((strobj = searchctx_text(ctx, str, text)) == NULL) {
+	str->str = NULL;
+	return;
+    }
+    if ((func_search = searchctx_search(ctx, rx)) == NULL) {
+	Py_DECREF(strobj);
+	str->str = NULL;
+	return;
+    }
+    args = Py_BuildValue("(O" ARG_FORMAT_SSIZE_T ARG_FORMAT_SSIZE_T ")",
+			 strobj, pos, endpos);
+    Py_DECREF(strobj);
+    if (args == NULL) {
+	Py_DECREF(func_search);
+	str->str = NULL;
+	return;
+    }
+    matchobj = PyObject_CallObject(func_search, args);
+    Py_DECREF(args);
+    Py_DECREF(func_search);
+    if (matchobj == NULL) {
+	str->str = NULL;
+	return;
     }
-    LineBreak_AS_CSTRUCT(newobj) = LineBreak_AS_CSTRUCT(tmp);
-    LineBreak_AS_CSTRUCT(tmp) = NULL;
-    Py_DECREF(tmp);
-    return newobj;
-}
 
-static PyGetSetDef LineBreak_getseters[];
+    if (matchobj != Py_None) {
+	if ((pyobj = PyObject_CallMethod(matchobj, "start", NULL)) == NULL) {
+	    Py_DECREF(matchobj);
+	    str->str = NULL;
+	    return;
+	}
+	start = PyLong_AsLong(pyobj);
+	Py_DECREF(pyobj);
+
+	if ((pyobj = PyObject_CallMethod(matchobj, "end", NULL)) == NULL) {
+	    Py_DECREF(matchobj);
+	    str->str = NULL;
+	    return;
+	}
+	end = PyLong_AsLong(pyobj);
+	Py_DECREF(pyobj);
+
+#ifdef OLDAPI_Py_UNICODE_NARROW
+	for (i = 0, pos = 0; i < start; i++, pos++)
+	    if (0x10000 <= text->str[pos])
+		i++;
+	for (endpos = pos; i < end; i++, endpos++)
+	    if (0x10000 <= text->str[endpos])
+		i++;
+	str->str = text->str + pos;
+	str->len = endpos - pos;
+#else				/* OLDAPI_Py_UNICODE_NARROW */
+	str->str = text->str + start;
+	str->len = end - start;
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
+    } else
+	str->str = NULL;
+    Py_DECREF(matchobj);
+}
 
+/*
+ * Concatenate partial result of breaking to result.
+ * If error occurred, -1 will be returned and both results will be kept.
+ */
 static int
-LineBreak_init(LineBreakObject * self, PyObject * args, PyObject * kwds)
+break_result_append(gcstring_t *** result, size_t * reslen,
+		    gcstring_t ** appe)
 {
-    PyObject *key, *value;
-    Py_ssize_t pos;
-    PyGetSetDef *getset;
-    char *keystr;
-
-    if (kwds == NULL)
-	return 0;
+    gcstring_t **r;
+    size_t i;
 
-    pos = 0;
-    while (PyDict_Next(kwds, &pos, &key, &value)) {
-	if ((keystr = genericstr_ToString(key)) == NULL)
-	    return -1;
-	for (getset = LineBreak_getseters; getset->name != NULL; getset++) {
-	    if (getset->set == NULL)
-		continue;
-	    if (strcmp(getset->name, keystr) != 0)
-		continue;
-	    if ((getset->set) ((PyObject *) self, value, NULL) != 0) {
-		free(keystr);
-		return -1;
-	    }
-	    break;
-	}
-	if (getset->name == NULL) {
-	    PyErr_Format(PyExc_ValueError, "invalid argument '%s'", keystr);
-	    free(keystr);
-	    return -1;
-	}
-	free(keystr);
-    }
+    for (i = 0; appe[i] != NULL; i++);
+    if ((r = realloc(*result, sizeof(gcstring_t *) * (*reslen + i + 1)))
+	== NULL)
+	return -1;
+    memcpy(r + *reslen, appe, sizeof(gcstring_t *) * (i + 1));
+    *result = r;
+    *reslen += i;
+    linebreak_free_result(appe, 0);
     return 0;
 }
 
+/* Number of characters broken at once by windows. */
+#define BREAK_WINDOW_SIZE (4096)
+
+#ifndef OLDAPI_Py_UNICODE_NARROW
 /*
- * Attribute methods
+ * Break 1-byte or 2-byte kind buffer.  Characters are widened by each
+ * small window passed to linebreak_break_partial() so that widened copy of
+ * whole text won't be made, unless lb has prep_func: matches of its regexes
+ * might cross windows.  If eot is true, the end of text is also
+ * processed.  Window is taken from heap since breaking may nest through
+ * callbacks.  ctx is search context of breaking, or NULL.
  */
-
-static PyObject * TDict_FromLineBreak(PyObject *, tdicttype);
-
-#define _get_Boolean(name, bit) \
-    static PyObject * \
-    LineBreak_get_##name(PyObject *self) \
+#define _do_break_KIND(kindname, ucstype) \
+    static gcstring_t ** \
+    do_break_##kindname(linebreak_t * lb, searchctx_t * ctx, \
+                        const ucstype * ucs, size_t len, int eot) \
     { \
-        PyObject *val; \
+        unichar_t *buf; \
+        unistr_t unistr; \
+        gcstring_t **ret, **appe; \
+        size_t i, j, winsize, reslen = 0; \
     \
-        val = (LineBreak_AS_CSTRUCT(self)->options & bit) ? \
-              Py_True : Py_False; \
-        Py_INCREF(val); \
-        return val; \
+        if (lb->prep_func != NULL || len < BREAK_WINDOW_SIZE) \
+            winsize = len + 1; \
+        else \
+            winsize = BREAK_WINDOW_SIZE; \
+        if ((ret = malloc(sizeof(gcstring_t *))) == NULL) \
+            return NULL; \
+        ret[0] = NULL; \
+        if ((buf = malloc(sizeof(unichar_t) * winsize)) == NULL) { \
+            free(ret); \
+            return NULL; \
+        } \
+        unistr.str = buf; \
+        for (i = 0; i < len; i += unistr.len) { \
+            unistr.len = (len - i < winsize) ? len - i : winsize; \
+            for (j = 0; j < unistr.len; j++) \
+                buf[j] = (unichar_t) ucs[i + j]; \
+            searchctx_next(ctx); \
+            if ((appe = linebreak_break_partial(lb, &unistr)) == NULL) \
+                break; \
+            if (break_result_append(&ret, &reslen, appe) != 0) { \
+                linebreak_free_result(appe, 1); \
+                appe = NULL; \
+                break; \
+            } \
+        } \
+        free(buf); \
+        if (i >= len && \
+            (!eot || \
+             (searchctx_next(ctx), \
+              (appe = linebreak_break_partial(lb, NULL)) != NULL && \
+              break_result_append(&ret, &reslen, appe) == 0))) \
+            return ret; \
+    \
+        if (appe != NULL) \
+            linebreak_free_result(appe, 1); \
+        if (!lb->errnum) \
+            lb->errnum = errno ? errno : ENOMEM; \
+        linebreak_free_result(ret, 1); \
+        return NULL; \
     }
 
-_get_Boolean(break_indent, LINEBREAK_OPTION_BREAK_INDENT)
+_do_break_KIND(UCS1, Py_UCS1)
+_do_break_KIND(UCS2, Py_UCS2)
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
 
-static PyObject *
-LineBreak_get_charmax(PyObject * self)
-{
-    return PyInt_FromSsize_t(LineBreak_AS_CSTRUCT(self)->charmax);
-}
+/*
+ * Texts shorter than this are broken holding GIL: releasing it would cost
+ * more than breaking them.
+ */
+#define BREAK_GIL_MINSIZE (2048)
 
-static PyObject *
-LineBreak_get_width(PyObject * self)
+/*
+ * Built-in sizing method same as linebreak_sizing_UAX11() except that
+ * horizontal tabs (classified to SP) in leading SPACEs advance to next
+ * tab stop.  Size of tab stops is given by sizing_data, Float object.
+ * It won't call Python API, so that it may be called without GIL.
+ */
+static double
+sizing_UAX11_TABS(linebreak_t * lb, double len,
+		  gcstring_t * pre, gcstring_t * spc, gcstring_t * str)
 {
-    return PyFloat_FromDouble(LineBreak_AS_CSTRUCT(self)->colmax);
+    double tabsize = PyFloat_AS_DOUBLE((PyObject *) lb->sizing_data);
+    gcstring_t *s;
+    gcchar_t *gc;
+    size_t i;
+    int k, leading = 1;
+
+    for (k = 0; k < 2; k++) {
+	if ((s = (k == 0) ? spc : str) == NULL)
+	    continue;
+	for (i = 0; i < s->gclen; i++) {
+	    gc = s->gcstr + i;
+	    if (gc->lbc != LB_SP)
+		leading = 0;
+	    if (leading && gc->len == 1 && s->str[gc->idx] == 0x0009) {
+		if (0.0 < tabsize)
+		    len += tabsize - fmod(len, tabsize);
+	    } else
+		len += (double) gc->col;
+	}
+    }
+    return len;
 }
 
-static PyObject *
-LineBreak_get_minwidth(PyObject * self)
+/*
+ * Make new string consisting of nquote quotation marks, nspace SPACEs,
+ * str (if any) and nnewline newline sequences.
+ */
+static gcstring_t *
+format_new(linebreak_t * lb, size_t nquote, size_t nspace, gcstring_t * str,
+	   size_t nnewline)
 {
-    return PyFloat_FromDouble(LineBreak_AS_CSTRUCT(self)->colmin);
+    unistr_t unistr;
+    gcstring_t *ret;
+    size_t i, j;
+
+    unistr.len = nquote + nspace + lb->newline.len * nnewline;
+    if (unistr.len == 0)
+	unistr.str = NULL;
+    else if ((unistr.str = malloc(sizeof(unichar_t) * unistr.len)) == NULL) {
+	lb->errnum = errno ? errno : ENOMEM;
+	return NULL;
+    }
+    for (i = 0; i < nquote; i++)
+	unistr.str[i] = 0x003E;
+    for (; i < nquote + nspace; i++)
+	unistr.str[i] = 0x0020;
+    for (j = 0; j < nnewline; j++, i += lb->newline.len)
+	memcpy(unistr.str + i, lb->newline.str,
+	       sizeof(unichar_t) * lb->newline.len);
+
+    if ((ret = gcstring_new(unistr.len ? &unistr : NULL, lb)) == NULL) {
+	free(unistr.str);
+	lb->errnum = errno ? errno : ENOMEM;
+	return NULL;
+    }
+    if (str != NULL && gcstring_append(ret, str) == NULL) {
+	gcstring_destroy(ret);
+	lb->errnum = errno ? errno : ENOMEM;
+	return NULL;
+    }
+    return ret;
 }
 
-_get_Boolean(complex_breaking, LINEBREAK_OPTION_COMPLEX_BREAKING)
+/*
+ * Check if string begins with ASCII string s.
+ */
+static int
+format_startswith(gcstring_t * gcstr, const char *s)
+{
+    size_t i;
 
-_get_Boolean(eastasian_context, LINEBREAK_OPTION_EASTASIAN_CONTEXT)
+    if (gcstr == NULL)
+	return 0;
+    for (i = 0; s[i] != '\0'; i++)
+	if (gcstr->len <= i || gcstr->str[i] != (unichar_t) s[i])
+	    return 0;
+    return 1;
+}
 
-static PyObject *
-LineBreak_get_eaw(PyObject * self)
+/*
+ * Built-in format "FIXED": Lines beginning with ">" won't be folded.
+ * Paragraphs are separated by empty line.  State is given by
+ * format_data, FormatState object.
+ * @note Width is set to 0 during quoted paragraph and taken from state at
+ * the start of each paragraph, so that it won't be lost even if breaking
+ * stopped within quoted paragraph.
+ */
+static gcstring_t *
+format_FIXED(linebreak_t * lb, linebreak_state_t action, gcstring_t * str)
 {
-    return TDict_FromLineBreak(self, TDICT_EAW);
+    FormatStateObject *state = (FormatStateObject *) lb->format_data;
+    gcstring_t *ret;
+
+    switch (action) {
+    case LINEBREAK_STATE_SOT:
+    case LINEBREAK_STATE_SOP:
+	state->line = 0;
+	lb->colmax = format_startswith(str, ">") ? 0.0 : state->width;
+	break;
+    case LINEBREAK_STATE_LINE:
+	state->line = (str != NULL && str->gclen != 0);
+	break;
+    case LINEBREAK_STATE_EOL:
+	return format_new(lb, 0, 0, NULL, 1);
+    case LINEBREAK_STATE_EOP:
+    case LINEBREAK_STATE_EOT:
+	ret = format_new(lb, 0, 0, NULL,
+			 (state->line && lb->colmax != 0.0) ? 2 : 1);
+	lb->colmax = state->width;
+	return ret;
+    default:
+	break;
+    }
+    errno = 0;
+    return NULL;
 }
 
-static PyObject *
-LineBreak_get_format(PyObject * self)
+/*
+ * Built-in format "FLOWED": "Format=Flowed; DelSp=Yes" defined by
+ * RFC 3676.  State is given by format_data, FormatState object.
+ */
+static gcstring_t *
+format_FLOWED(linebreak_t * lb, linebreak_state_t action, gcstring_t * str)
 {
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
-    PyObject *val;
+    FormatStateObject *state = (FormatStateObject *) lb->format_data;
+    size_t i;
 
-    if (lb->format_func == NULL) {
-	Py_RETURN_NONE;
-    } else if (lb->format_func == linebreak_format_NEWLINE)
-	val = TEXTSEG_NEWLINE;
-    else if (lb->format_func == linebreak_format_SIMPLE)
-	val = TEXTSEG_SIMPLE;
-    else if (lb->format_func == linebreak_format_TRIM)
-	val = TEXTSEG_TRIM;
-    else if (lb->format_func == format_func)
-	val = (PyObject *) lb->format_data;
-    else {
-	PyErr_Format(PyExc_RuntimeError, "internal error");
-	return NULL;
+    switch (action) {
+    case LINEBREAK_STATE_SOT:
+    case LINEBREAK_STATE_SOP:
+	state->line = 0;
+	for (i = 0; str != NULL && i < str->len && str->str[i] == 0x003E;
+	     i++);
+	state->prefix = i;
+	/* space-stuffing */
+	if (i == 0 &&
+	    (format_startswith(str, " ") || format_startswith(str, "From ")))
+	    return format_new(lb, 0, 1, str, 0);
+	break;
+    case LINEBREAK_STATE_SOL:
+	if (state->prefix)
+	    return format_new(lb, state->prefix, 1, str, 0);
+	if (format_startswith(str, " ") || format_startswith(str, "From ") ||
+	    format_startswith(str, ">"))
+	    return format_new(lb, 0, 1, str, 0);
+	break;
+    case LINEBREAK_STATE_LINE:
+	state->line = (str != NULL && str->gclen != 0);
+	break;
+    case LINEBREAK_STATE_EOL:
+	/* trailing SPACE of flowed line */
+	return format_new(lb, 0, (str != NULL && str->gclen) ? 2 : 1,
+			  NULL, 1);
+    case LINEBREAK_STATE_EOP:
+    case LINEBREAK_STATE_EOT:
+	if (state->line && !state->prefix)
+	    return format_new(lb, 0, 1, NULL, 2);
+	return format_new(lb, 0, 0, NULL, 1);
+    default:
+	break;
     }
-    Py_INCREF(val);
-    return val;
+    errno = 0;
+    return NULL;
 }
 
-_get_Boolean(hangul_as_al, LINEBREAK_OPTION_HANGUL_AS_AL)
+static PyTypeObject FormatState_Type = {
+#if PY_MAJOR_VERSION >= 3
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else				/* PY_MAJOR_VERSION */
+    PyObject_HEAD_INIT(NULL)
+    0,				/*ob_size */
+#endif				/* PY_MAJOR_VERSION */
+    "_textseg.FormatState",	/*tp_name */
+    sizeof(FormatStateObject),	/*tp_basicsize */
+    0,				/*tp_itemsize */
+    0,				/*tp_dealloc */
+    0,				/*tp_print */
+    0,				/*tp_getattr */
+    0,				/*tp_setattr */
+    0,				/*tp_compare */
+    0,				/*tp_repr */
+    0,				/*tp_as_number */
+    0,				/*tp_as_sequence */
+    0,				/*tp_as_mapping */
+    0,				/*tp_hash */
+    0,				/*tp_call */
+    0,				/*tp_str */
+    0,				/*tp_getattro */
+    0,				/*tp_setattro */
+    0,				/*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,		/*tp_flags */
+    "FormatState objects",	/* tp_doc */
+};
 
-static PyObject *
-LineBreak_get_lbc(PyObject * self)
+/*
+ * Get width of linebreak object, which may be changed by built-in format
+ * during breaking.
+ */
+static double
+format_get_width(linebreak_t * lb)
 {
-    return TDict_FromLineBreak(self, TDICT_LBC);
+    if (lb->format_func == format_FIXED)
+	return ((FormatStateObject *) lb->format_data)->width;
+    return lb->colmax;
 }
 
-_get_Boolean(legacy_cm, LINEBREAK_OPTION_LEGACY_CM)
-
-static PyObject *
-LineBreak_get_newline(PyObject * self)
+/*
+ * Set width of linebreak object.
+ */
+static void
+format_set_width(linebreak_t * lb, double width)
 {
-    return unicode_FromCstruct(&(LineBreak_AS_CSTRUCT(self)->newline));
+    if (lb->format_func == format_FIXED || lb->format_func == format_FLOWED)
+	((FormatStateObject *) lb->format_data)->width = width;
+    lb->colmax = width;
 }
 
-static PyObject *
-LineBreak_get_prep(PyObject * self)
+/*
+ * Set built-in format keeping its state.  If orig is not NULL, state is
+ * copied from it.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+format_set_state(linebreak_t * lb,
+		 gcstring_t * (*func) (linebreak_t *, linebreak_state_t,
+				       gcstring_t *),
+		 FormatStateObject * orig)
 {
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
-    PyObject *val;
+    FormatStateObject *state;
 
-    if (lb->prep_func == NULL || lb->prep_func[0] == NULL) {
-	val = Py_None;
-	Py_INCREF(val);
+    if ((state = PyObject_New(FormatStateObject, &FormatState_Type))
+	== NULL)
+	return -1;
+    if (orig != NULL) {
+	state->width = orig->width;
+	state->prefix = orig->prefix;
+	state->line = orig->line;
     } else {
-	size_t i;
-	PyObject *v;
-	val = PyList_New(0);
-	for (i = 0; lb->prep_func[i] != NULL; i++) {
-	    if (lb->prep_func[i] == linebreak_prep_URIBREAK) {
-		if (lb->prep_data == NULL || lb->prep_data[i] == NULL)
-		    v = TEXTSEG_NONBREAKURI;
-		else
-		    v = TEXTSEG_BREAKURI;
-	    } else if (lb->prep_data == NULL || lb->prep_data[i] == NULL) {
-		v = Py_None;
-	    } else {
-		v = lb->prep_data[i];
-	    }
-	    /* Py_INCREF(v) */
-	    PyList_Append(val, v);
-	}
+	state->width = lb->colmax;
+	state->prefix = 0;
+	state->line = 0;
     }
-    return val;
+    linebreak_set_format(lb, func, (void *) state);
+    Py_DECREF(state);		/* fixup */
+    return 0;
 }
 
-static PyObject *
-LineBreak_get_sizing(PyObject * self)
+/*
+ * Copy linebreak object.  Unlike linebreak_copy(), the copy has its own
+ * state of built-in formats, so that it may be used by another thread.
+ * If error occurred, NULL will be returned and errno will be set.
+ */
+static linebreak_t *
+break_copy(linebreak_t * lb)
 {
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
-    PyObject *val;
+    linebreak_t *ret;
 
-    if (lb->sizing_func == NULL) {
-	Py_RETURN_NONE;
-    } else if (lb->sizing_func == linebreak_sizing_UAX11)
-	val = TEXTSEG_UAX11;
-    else if (lb->sizing_func == sizing_func)
-	val = (PyObject *) lb->sizing_data;
-    else {
-	PyErr_Format(PyExc_RuntimeError, "internal error");
+    if ((ret = linebreak_copy(lb)) == NULL)
+	return NULL;
+    if ((ret->format_func == format_FIXED ||
+	 ret->format_func == format_FLOWED) &&
+	format_set_state(ret, ret->format_func,
+			 (FormatStateObject *) lb->format_data) != 0) {
+	PyErr_Clear();
+	linebreak_destroy(ret);
+	errno = ENOMEM;
 	return NULL;
     }
-    Py_INCREF(val);
-
-    return val;
+    return ret;
 }
 
-static PyObject *
-LineBreak_get_urgent(PyObject * self)
+/*
+ * Make linebreak object of LineBreak object self private, if it is shared
+ * with copies of self, so that it may be modified.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+LineBreak_Unshare(PyObject * self)
 {
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
-    PyObject *val;
-
-    if (lb->urgent_func == NULL) {
-	Py_RETURN_NONE;
-    } else if (lb->urgent_func == linebreak_urgent_ABORT)
-	val = TEXTSEG_RAISE;
-    else if (lb->urgent_func == linebreak_urgent_FORCE)
-	val = TEXTSEG_FORCE;
-    else if (lb->urgent_func == urgent_func) {
-	val = (PyObject *) lb->urgent_data;
-    } else {
-	PyErr_Format(PyExc_RuntimeError, "internal error");
-	return NULL;
-    }
+    LineBreakObject *obj = (LineBreakObject *) self;
+    linebreak_t *lb;
 
-    Py_INCREF(val);
-    return val;
+    if (obj->nshare == NULL)
+	return 0;
+    if (1 < *obj->nshare) {
+	if ((lb = break_copy(obj->obj)) == NULL) {
+	    PyErr_SetFromErrno(PyExc_RuntimeError);
+	    return -1;
+	}
+	(*obj->nshare)--;
+	linebreak_destroy(obj->obj);
+	obj->obj = lb;
+    } else
+	free(obj->nshare);
+    obj->nshare = NULL;
+    return 0;
 }
 
-_get_Boolean(virama_as_joiner, LINEBREAK_OPTION_VIRAMA_AS_JOINER)
+/*
+ * Check if all callbacks of linebreak object are built-in functions of
+ * linebreak library, i.e. breaking by it never calls Python.
+ */
+static int
+linebreak_is_builtin(linebreak_t * lb)
+{
+    size_t i;
 
-#define _set_Boolean(name, bit) \
-    static int \
-    LineBreak_set_##name(PyObject *self, PyObject *arg, void *closure) \
-    { \
-        linebreak_t *lb = LineBreak_AS_CSTRUCT(self); \
-        long ival; \
-    \
-        if (arg == NULL) { \
-	    PyErr_Format(PyExc_NotImplementedError, \
-		         "Can not delete attribute"); \
-	    return -1; \
-        } \
-    \
-        ival = PyInt_AsLong(arg); \
-        if (PyErr_Occurred()) \
-	    return -1; \
-        if (ival) \
-	    lb->options |= bit; \
-        else \
-	    lb->options &= ~bit; \
-	return 0; \
-    }
+    if (lb->format_func != NULL &&
+	lb->format_func != linebreak_format_NEWLINE &&
+	lb->format_func != linebreak_format_SIMPLE &&
+	lb->format_func != linebreak_format_TRIM &&
+	lb->format_func != format_FIXED &&
+	lb->format_func != format_FLOWED)
+	return 0;
+    if (lb->sizing_func != NULL &&
+	lb->sizing_func != linebreak_sizing_UAX11 &&
+	lb->sizing_func != sizing_UAX11_TABS)
+	return 0;
+    if (lb->urgent_func != NULL &&
+	lb->urgent_func != linebreak_urgent_ABORT &&
+	lb->urgent_func != linebreak_urgent_FORCE)
+	return 0;
+    if (lb->user_func != NULL)
+	return 0;
+    if (lb->prep_func != NULL)
+	for (i = 0; lb->prep_func[i] != NULL; i++)
+	    if (lb->prep_func[i] != linebreak_prep_URIBREAK)
+		return 0;
+    return 1;
+}
 
-static int tdict_update(PyObject *, PyObject *, int);
+/*
+ * Text to be broken.
+ */
+typedef struct {
+    /* Object owning buffer, or NULL if unistr was converted. */
+    PyObject *owner;
+    unistr_t unistr;
+    /* 1-byte or 2-byte kind to break buffer of owner by windows, or 0. */
+    int kind;
+    /* Number of characters. */
+    size_t len;
+} breakinput_t;
 
+/*
+ * Get text to be broken from Python object.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
 static int
-LineBreak_set_linebreakType(PyObject * self, PyObject * value, void *closure)
+breakinput_init(breakinput_t * in, PyObject * pyobj)
 {
-    if (! PyType_Check(value)) {
-	PyErr_Format(PyExc_ValueError, "expected type object, %200s found",
-		     Py_TYPE(value)->tp_name);
+#ifndef OLDAPI_Py_UNICODE_NARROW
+    PyObject *pystr;
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
+
+    in->owner = NULL;
+    in->unistr.str = NULL;
+    in->unistr.len = 0;
+    in->kind = 0;
+
+#ifndef OLDAPI_Py_UNICODE_NARROW
+    if (PyUnicode_Check(pyobj)) {
+	pystr = pyobj;
+	Py_INCREF(pystr);
+    } else if ((pystr = PyObject_Unicode(pyobj)) == NULL)
 	return -1;
-    }
-    if (! PyType_IsSubtype((PyTypeObject *)value, &LineBreak_Type)) {
-	PyErr_Format(PyExc_ValueError, "expected LineBreak type, %200s found",
-		     ((PyTypeObject *)value)->tp_name);
+    if (PyUnicode_READY(pystr) != 0) {
+	Py_DECREF(pystr);
 	return -1;
     }
-    Py_INCREF(value);	/* ref. to be stolen */
-    if (PyTuple_SetItem(LineBreak_AS_CSTRUCT(self)->stash, 1, value) != 0)
+    in->kind = PyUnicode_KIND(pystr);
+    if ((in->kind == PyUnicode_1BYTE_KIND &&
+	 sizeof(Py_UCS1) != sizeof(unichar_t)) ||
+	(in->kind == PyUnicode_2BYTE_KIND &&
+	 sizeof(Py_UCS2) != sizeof(unichar_t))) {
+	in->owner = pystr;
+	in->len = PyUnicode_GET_LENGTH(pystr);
+    } else {
+	in->kind = 0;
+	if (unicode_BorrowCstruct(&in->unistr, pystr, &in->owner) == NULL) {
+	    Py_DECREF(pystr);
+	    return -1;
+	}
+	Py_DECREF(pystr);
+	in->len = in->unistr.len;
+    }
+#else				/* OLDAPI_Py_UNICODE_NARROW */
+    if (unicode_ToCstruct(&in->unistr, pyobj) == NULL)
 	return -1;
+    in->len = in->unistr.len;
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
     return 0;
 }
 
-static int
-LineBreak_set_gcstrType(PyObject * self, PyObject * value, void *closure)
+/*
+ * Release text got by breakinput_init().
+ */
+static void
+breakinput_release(breakinput_t * in)
 {
-    if (! PyType_Check(value)) {
-	PyErr_Format(PyExc_ValueError, "expected type object, %200s found",
-		     Py_TYPE(value)->tp_name);
-	return -1;
-    }
-    if (! PyType_IsSubtype((PyTypeObject *)value, &GCStr_Type)) {
-	PyErr_Format(PyExc_ValueError, "expected GCStr type, %200s found",
-		     ((PyTypeObject *)value)->tp_name);
-	return -1;
-    }
-    Py_INCREF(value);	/* ref. to be stolen */
-    if (PyTuple_SetItem(LineBreak_AS_CSTRUCT(self)->stash, 2, value) != 0)
-	return -1;
-    return 0;
+    unicode_ReleaseCstruct(&in->unistr, in->owner);
+    in->owner = NULL;
 }
 
-static int
-LineBreak_set_exceptionType(PyObject * self, PyObject * value, void *closure)
+/*
+ * Break len characters of text from pos by linebreak object.  Result will
+ * be the same as linebreak_break().
+ * ctx is search context of breaking, or NULL.
+ * @note This function itself never calls Python API.
+ */
+static gcstring_t **
+breakinput_break(linebreak_t * lbobj, searchctx_t * ctx, breakinput_t * in,
+		 size_t pos, size_t len)
 {
-    if (! PyType_Check(value)) {
-	PyErr_Format(PyExc_ValueError, "expected type object, %200s found",
-		     Py_TYPE(value)->tp_name);
-	return -1;
-    }
-    if (! PyType_IsSubtype((PyTypeObject *)value,
-			   (PyTypeObject *)PyExc_Exception)) {
-	PyErr_Format(PyExc_ValueError, "expected Exception type, %200s found",
-		     ((PyTypeObject *)value)->tp_name);
-	return -1;
-    }
-    Py_INCREF(value);	/* ref. to be stolen */
-    if (PyTuple_SetItem(LineBreak_AS_CSTRUCT(self)->stash, 3, value) != 0)
-	return -1;
-    return 0;
+    unistr_t unistr;
+
+    linebreak_reset(lbobj);
+#ifndef OLDAPI_Py_UNICODE_NARROW
+    if (in->kind == PyUnicode_1BYTE_KIND)
+	return do_break_UCS1(lbobj, ctx,
+			     PyUnicode_1BYTE_DATA(in->owner) + pos, len, 1);
+    else if (in->kind == PyUnicode_2BYTE_KIND)
+	return do_break_UCS2(lbobj, ctx,
+			     PyUnicode_2BYTE_DATA(in->owner) + pos, len, 1);
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
+    unistr.str = (in->unistr.str == NULL) ? NULL : in->unistr.str + pos;
+    unistr.len = len;
+    searchctx_next(ctx);
+    /* linebreak_break() never modifies nor keeps input. */
+    return linebreak_break(lbobj, &unistr);
 }
 
-_set_Boolean(break_indent, LINEBREAK_OPTION_BREAK_INDENT)
-
-static int
-LineBreak_set_charmax(PyObject * self, PyObject * value, void *closure)
+/*
+ * Break len characters of text from pos by linebreak object continuing
+ * from previous call.  If in is NULL, the end of text is processed.
+ * Result will be the same as linebreak_break_partial().
+ * ctx is search context of breaking, or NULL.
+ */
+static gcstring_t **
+breakinput_break_partial(linebreak_t * lbobj, searchctx_t * ctx,
+			 breakinput_t * in, size_t pos, size_t len)
 {
-    long ival;
+    unistr_t unistr;
 
-    if (value == NULL) {
-	PyErr_Format(PyExc_NotImplementedError,
-		     "Can not delete attribute");
-	return -1;
+    if (in == NULL) {
+	searchctx_next(ctx);
+	return linebreak_break_partial(lbobj, NULL);
     }
-    if (PyInt_Check(value))
-	ival = (long) PyInt_AsLong(value);
-    else if (PyLong_Check(value))
-	ival = PyInt_AsLong(value);
-    else {
-	PyErr_Format(PyExc_TypeError,
-		     "attribute must be non-negative integer, not %200s",
-		     Py_TYPE(value)->tp_name);
-	return -1;
-    }
-    if (ival < 0) {
-	PyErr_Format(PyExc_ValueError,
-		     "attribute must be non-negative integer, not %ld",
-		     ival);
-	return -1;
-    }
-    LineBreak_AS_CSTRUCT(self)->charmax = ival;
-    return 0;
+#ifndef OLDAPI_Py_UNICODE_NARROW
+    if (in->kind == PyUnicode_1BYTE_KIND)
+	return do_break_UCS1(lbobj, ctx,
+			     PyUnicode_1BYTE_DATA(in->owner) + pos, len, 0);
+    else if (in->kind == PyUnicode_2BYTE_KIND)
+	return do_break_UCS2(lbobj, ctx,
+			     PyUnicode_2BYTE_DATA(in->owner) + pos, len, 0);
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
+    unistr.str = (in->unistr.str == NULL) ? NULL : in->unistr.str + pos;
+    unistr.len = len;
+    searchctx_next(ctx);
+    /* linebreak_break_partial() never modifies nor keeps input. */
+    return linebreak_break_partial(lbobj, &unistr);
 }
 
-static int
-LineBreak_set_width(PyObject * self, PyObject * value, void *closure)
+/*
+ * Raise exception by error number linebreak object set.
+ */
+static void
+break_seterror(linebreak_t * lb, int errnum)
 {
-    double dval;
+    if (errnum == LINEBREAK_ELONG)
+	PyErr_SetString((PyObject *)STASH_EXCEPTION(lb),
+			"Excessive line was found");
+    else if (errnum) {
+	errno = errnum;
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+    } else
+	PyErr_SetString(PyExc_RuntimeError, "unknown error");
+}
 
-    if (value == NULL) {
-	PyErr_Format(PyExc_NotImplementedError,
-		     "Can not delete attribute");
-	return -1;
-    }
-    if (PyInt_Check(value))
-	dval = (double) PyInt_AsLong(value);
-    else if (PyLong_Check(value))
-	dval = (double) PyInt_AsLong(value);
-    else if (PyFloat_Check(value))
-	dval = PyFloat_AsDouble(value);
-    else {
-	PyErr_Format(PyExc_TypeError,
-		     "attribute must be non-negative real number, not %200s",
-		     Py_TYPE(value)->tp_name);
-	return -1;
-    }
-    if (dval < 0.0) {
-	PyErr_Format(PyExc_ValueError,
-		     "attribute must be non-negative real number, not %f",
-		     dval);
-	return -1;
-    }
-    LineBreak_AS_CSTRUCT(self)->colmax = dval;
-    return 0;
+/*
+ * Break len characters of text from pos.  Result will be the same as
+ * linebreak_break().
+ * owner is LineBreak object passed to Python callbacks, or NULL.
+ * If error occurred, exception will be raised and NULL will be returned.
+ * @note When no Python callbacks are used, long text is broken by a
+ * private copy of linebreak object releasing GIL, so that the same object
+ * may be used by several threads at once.  Results will refer the copy.
+ * If owner is frozen, lb must be got by LineBreak_AcquireCstruct() and
+ * is used as it is.
+ */
+static gcstring_t **
+do_break_input(linebreak_t * lb, PyObject * owner, breakinput_t * in,
+	       size_t pos, size_t len)
+{
+    gcstring_t **broken;
+    searchctx_t ctx;
+    linebreak_t *lbobj;
+    PyThreadState *tstate = NULL;
+    int nogil;
+
+    nogil = (BREAK_GIL_MINSIZE <= len && linebreak_is_builtin(lb));
+    /* linebreak object of frozen LineBreak is a private copy. */
+    if (nogil && !(owner != NULL && FrozenLineBreak_Check(owner))) {
+	if ((lbobj = break_copy(lb)) == NULL) {
+	    PyErr_SetFromErrno(PyExc_RuntimeError);
+	    return NULL;
+	}
+	/* Text given by feed() is discarded as if lb itself were used. */
+	linebreak_reset(lb);
+    } else
+	lbobj = lb;
+    if (!nogil && searchctx_begin(&ctx, lb, owner) != 0)
+	return NULL;
+
+    /* Python API must not be called while GIL is released. */
+    if (nogil)
+	tstate = PyEval_SaveThread();
+    broken = breakinput_break(lbobj, nogil ? NULL : &ctx, in, pos, len);
+    if (tstate != NULL)
+	PyEval_RestoreThread(tstate);
+
+    if (!nogil)
+	searchctx_end(&ctx);
+
+    if (PyErr_Occurred()) {
+	linebreak_free_result(broken, 1);
+	broken = NULL;
+    } else if (broken == NULL)
+	break_seterror(lb, lbobj->errnum);
+    if (lbobj != lb)
+	linebreak_destroy(lbobj);
+    return broken;
 }
 
-static int
-LineBreak_set_minwidth(PyObject * self, PyObject * value, void *closure)
+/*
+ * Break text.  Result will be the same as linebreak_break().
+ * See do_break_input().
+ */
+static gcstring_t **
+do_break_unicode(linebreak_t * lb, PyObject * owner, PyObject * pyobj)
 {
-    double dval;
+    breakinput_t in;
+    gcstring_t **broken;
 
-    if (value == NULL) {
-	PyErr_Format(PyExc_NotImplementedError,
-		     "Can not delete attribute");
-	return -1;
-    }
-    if (PyInt_Check(value))
-	dval = (double) PyInt_AsLong(value);
-    else if (PyLong_Check(value))
-	dval = (double) PyInt_AsLong(value);
-    else if (PyFloat_Check(value))
-	dval = PyFloat_AsDouble(value);
-    else {
-	PyErr_Format(PyExc_TypeError,
-		     "attribute must be non-negative real number, not %200s",
-		     Py_TYPE(value)->tp_name);
-	return -1;
-    }
-    if (dval < 0.0) {
-	PyErr_Format(PyExc_ValueError,
-		     "attribute must be non-negative real number, not %f",
-		     dval);
-	return -1;
-    }
-    LineBreak_AS_CSTRUCT(self)->colmin = dval;
-    return 0;
+    if (breakinput_init(&in, pyobj) != 0)
+	return NULL;
+    broken = do_break_input(lb, owner, &in, 0, in.len);
+    breakinput_release(&in);
+    return broken;
 }
 
-_set_Boolean(complex_breaking, LINEBREAK_OPTION_COMPLEX_BREAKING)
+/*
+ * Break len characters of text from pos incrementally, keeping state in
+ * linebreak object.  If in is NULL, the rest of text is broken and state
+ * is cleared.  Result will be the same as linebreak_break_partial().
+ * owner is LineBreak object passed to Python callbacks, or NULL.
+ * If error occurred, exception will be raised and NULL will be returned.
+ */
+static gcstring_t **
+do_break_partial(linebreak_t * lb, PyObject * owner, breakinput_t * in,
+		 size_t pos, size_t len)
+{
+    gcstring_t **broken;
+    searchctx_t ctx;
 
-_set_Boolean(eastasian_context, LINEBREAK_OPTION_EASTASIAN_CONTEXT)
+    if (searchctx_begin(&ctx, lb, owner) != 0)
+	return NULL;
+    broken = breakinput_break_partial(lb, &ctx, in, pos, len);
+    searchctx_end(&ctx);
 
-static int
-LineBreak_set_eaw(PyObject * self, PyObject * value, void *closure)
+    if (PyErr_Occurred()) {
+	linebreak_free_result(broken, 1);
+	broken = NULL;
+    } else if (broken == NULL)
+	break_seterror(lb, lb->errnum);
+    return broken;
+}
+
+/*
+ * A range of text broken by do_break_many().
+ */
+typedef struct {
+    breakinput_t *in;
+    size_t pos;
+    size_t len;
+    /* Result, or NULL with error number. */
+    gcstring_t **broken;
+    int errnum;
+} breakjob_t;
+
+typedef struct {
+    breakjob_t *jobs;
+    size_t njobs;
+    /* Index of next job to be taken. */
+    size_t next;
+#ifdef WITH_THREAD
+    PyThread_type_lock lock;
+#endif				/* WITH_THREAD */
+} breakpool_t;
+
+typedef struct {
+    breakpool_t *pool;
+    /* Private copy of linebreak object. */
+    linebreak_t *lbobj;
+#ifdef WITH_THREAD
+    /* Held until worker thread finishes, or NULL for calling thread. */
+    PyThread_type_lock done;
+#endif				/* WITH_THREAD */
+} breakworker_t;
+
+/*
+ * Take jobs in turn and break them, until no jobs are left.
+ * @note This function runs without GIL.
+ */
+static void
+breakworker_run(void *arg)
 {
-    PyObject *tdict;
-    int result = 0;
+    breakworker_t *worker = (breakworker_t *) arg;
+    breakpool_t *pool = worker->pool;
+    breakjob_t *job;
+    size_t i;
 
-    if (value == NULL) {
-	PyErr_SetString(PyExc_AttributeError, "cannot remove attribute");
-	return -1;
+    while (1) {
+#ifdef WITH_THREAD
+	PyThread_acquire_lock(pool->lock, WAIT_LOCK);
+#endif				/* WITH_THREAD */
+	i = pool->next++;
+#ifdef WITH_THREAD
+	PyThread_release_lock(pool->lock);
+#endif				/* WITH_THREAD */
+	if (pool->njobs <= i)
+	    break;
+
+	job = pool->jobs + i;
+	if ((job->broken = breakinput_break(worker->lbobj, NULL, job->in,
+					    job->pos, job->len)) == NULL)
+	    job->errnum = worker->lbobj->errnum;
     }
-    if ((tdict = TDict_FromLineBreak(self, TDICT_EAW)) == NULL)
-	return -1;
-    result = tdict_update(tdict, value, 1);
-    Py_DECREF(tdict);
-    return result;
+#ifdef WITH_THREAD
+    if (worker->done != NULL)
+	PyThread_release_lock(worker->done);
+#endif				/* WITH_THREAD */
 }
 
+/*
+ * Break several texts by up to nthreads native threads releasing GIL.
+ * Each thread uses its own copy of linebreak object.  Input of jobs must be
+ * initialized by breakinput_init(); result and error number are stored
+ * into each job.
+ * If error other than failure of breaking occurred, exception will be
+ * raised and -1 will be returned.
+ * @note linebreak object must not have any Python callbacks.
+ */
 static int
-LineBreak_set_format(PyObject * self, PyObject * value, void *closure)
+do_break_many(linebreak_t * lb, breakjob_t * jobs, size_t njobs,
+	      int nthreads)
 {
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    breakpool_t pool;
+    breakworker_t *workers;
+    PyThreadState *tstate;
+    size_t i;
+    int nworkers, w;
 
-    if (value == NULL)
-	linebreak_set_format(lb, NULL, NULL);
-    else if (value == Py_None)
-	linebreak_set_format(lb, NULL, NULL);
-    else if (PyString_Check(value) || PyUnicode_Check(value)) {
-	char *str;
-	if ((str = genericstr_ToString(value)) == NULL)
-	    return -1;
+    for (i = 0; i < njobs; i++) {
+	jobs[i].broken = NULL;
+	jobs[i].errnum = 0;
+    }
+    if (njobs == 0)
+	return 0;
 
-	if (strcasecmp(str, "SIMPLE") == 0)
-	    linebreak_set_format(lb, linebreak_format_SIMPLE, NULL);
-	else if (strcasecmp(str, "NEWLINE") == 0)
-	    linebreak_set_format(lb, linebreak_format_NEWLINE, NULL);
-	else if (strcasecmp(str, "TRIM") == 0)
-	    linebreak_set_format(lb, linebreak_format_TRIM, NULL);
-	else {
-	    PyErr_Format(PyExc_ValueError,
-			 "unknown attribute value, %200s", str);
+#ifdef WITH_THREAD
+    nworkers = (njobs < (size_t) nthreads) ? (int) njobs : nthreads;
+#else				/* WITH_THREAD */
+    nworkers = 1;
+#endif				/* WITH_THREAD */
+    if (nworkers < 1)
+	nworkers = 1;
 
-	    free(str);
+    if ((workers = PyMem_Malloc(sizeof(breakworker_t) * nworkers)) == NULL) {
+	PyErr_NoMemory();
+	return -1;
+    }
+    pool.jobs = jobs;
+    pool.njobs = njobs;
+    pool.next = 0;
+#ifdef WITH_THREAD
+    if ((pool.lock = PyThread_allocate_lock()) == NULL) {
+	PyMem_Free(workers);
+	PyErr_SetString(PyExc_RuntimeError, "can't allocate lock");
+	return -1;
+    }
+#endif				/* WITH_THREAD */
+    for (w = 0; w < nworkers; w++) {
+	workers[w].pool = &pool;
+#ifdef WITH_THREAD
+	workers[w].done = NULL;
+#endif				/* WITH_THREAD */
+	if ((workers[w].lbobj = break_copy(lb)) == NULL) {
+	    PyErr_SetFromErrno(PyExc_RuntimeError);
+	    while (0 < w--)
+		linebreak_destroy(workers[w].lbobj);
+#ifdef WITH_THREAD
+	    PyThread_free_lock(pool.lock);
+#endif				/* WITH_THREAD */
+	    PyMem_Free(workers);
 	    return -1;
 	}
-	free(str);
-    } else if (PyFunction_Check(value))
-	linebreak_set_format(lb, format_func, (void *) value);
-    else {
-	PyErr_Format(PyExc_ValueError,
-		     "attribute must be list, not %200s",
-		     Py_TYPE(value)->tp_name);
-	return -1;
     }
+
+    /* Python API must not be called while GIL is released. */
+    tstate = PyEval_SaveThread();
+#ifdef WITH_THREAD
+    /* Threads failed to start are not fatal: remaining jobs are taken by
+     * other workers. */
+    for (w = 1; w < nworkers; w++) {
+	if ((workers[w].done = PyThread_allocate_lock()) == NULL)
+	    continue;
+	PyThread_acquire_lock(workers[w].done, WAIT_LOCK);
+	if (PyThread_start_new_thread(breakworker_run, workers + w) ==
+	    PYTHREAD_INVALID_THREAD_ID) {
+	    PyThread_release_lock(workers[w].done);
+	    PyThread_free_lock(workers[w].done);
+	    workers[w].done = NULL;
+	}
+    }
+#endif				/* WITH_THREAD */
+    breakworker_run(workers);
+#ifdef WITH_THREAD
+    for (w = 1; w < nworkers; w++)
+	if (workers[w].done != NULL) {
+	    PyThread_acquire_lock(workers[w].done, WAIT_LOCK);
+	    PyThread_release_lock(workers[w].done);
+	    PyThread_free_lock(workers[w].done);
+	}
+#endif				/* WITH_THREAD */
+    PyEval_RestoreThread(tstate);
+
+    for (w = 0; w < nworkers; w++)
+	linebreak_destroy(workers[w].lbobj);
+#ifdef WITH_THREAD
+    PyThread_free_lock(pool.lock);
+#endif				/* WITH_THREAD */
+    PyMem_Free(workers);
     return 0;
 }
 
-_set_Boolean(hangul_as_al, LINEBREAK_OPTION_HANGUL_AS_AL)
+/*
+ * Texts shorter than twice of this are not broken in parallel.  Each
+ * range broken by one job is not shorter than this, either.
+ */
+#define BREAK_PARALLEL_MINSIZE (65536)
 
-static int
-LineBreak_set_lbc(PyObject * self, PyObject * value, void *closure)
+/*
+ * Get a character of text.
+ */
+static unichar_t
+breakinput_char(breakinput_t * in, size_t i)
 {
-    PyObject *tdict;
-    int result = 0;
-
-    if (value == NULL) {
-	PyErr_SetString(PyExc_AttributeError, "cannot remove attribute");
-	return -1;
-    }
-    if ((tdict = TDict_FromLineBreak(self, TDICT_LBC)) == NULL)
-        return -1;
-    result = tdict_update(tdict, value, 1);
-    Py_DECREF(tdict);
-    return result;
+#ifndef OLDAPI_Py_UNICODE_NARROW
+    if (in->kind == PyUnicode_1BYTE_KIND)
+	return (unichar_t) PyUnicode_1BYTE_DATA(in->owner)[i];
+    else if (in->kind == PyUnicode_2BYTE_KIND)
+	return (unichar_t) PyUnicode_2BYTE_DATA(in->owner)[i];
+#endif				/* OLDAPI_Py_UNICODE_NARROW */
+    return in->unistr.str[i];
 }
 
-_set_Boolean(legacy_cm, LINEBREAK_OPTION_LEGACY_CM)
+/*
+ * Check if line breaking class ends paragraph.
+ */
+#define lbclass_is_eop(lbc) \
+    ((lbc) == LB_BK || (lbc) == LB_CR || (lbc) == LB_LF || (lbc) == LB_NL)
 
+/*
+ * Check if tailoring map of linebreak object gives any character a class
+ * ending paragraph.
+ */
 static int
-LineBreak_set_newline(PyObject * self, PyObject * value, void *closure)
+linebreak_has_tailored_eop(linebreak_t * lb)
 {
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
-    unistr_t unistr = { NULL, 0 };
+    size_t i;
 
-    if (value == NULL)
-	linebreak_set_newline(lb, &unistr);
-    else if (value == Py_None)
-	linebreak_set_newline(lb, &unistr);
-    else {
-	if (unicode_ToCstruct(&unistr, value) == NULL)
-	    return -1;
-	linebreak_set_newline(lb, &unistr);
-	free(unistr.str);
-    }
+    if (lb->map == NULL)
+	return 0;
+    for (i = 0; i < lb->mapsiz; i++)
+	if (lbclass_is_eop(lb->map[i].lbc))
+	    return 1;
     return 0;
 }
 
+/*
+ * Check if character c is tailored to a class ending paragraph.
+ * Entries of tailoring map are sorted and not overlapping.
+ */
 static int
-LineBreak_set_prep(PyObject * self, PyObject * value, void *closure)
+linebreak_is_tailored_eop(linebreak_t * lb, unichar_t c)
 {
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
-    Py_ssize_t i, len;
-    PyObject *item;
-    char *str;
+    size_t lo = 0, hi = lb->mapsiz, mid;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (c < lb->map[mid].beg)
+	    hi = mid;
+	else if (lb->map[mid].end < c)
+	    lo = mid + 1;
+	else
+	    return lbclass_is_eop(lb->map[mid].lbc);
+    }
+    return 0;
+}
 
-    if (value == NULL)
-	linebreak_add_prep(lb, NULL, NULL);
-    else if (value == Py_None)
-	linebreak_add_prep(lb, NULL, NULL);
-    else if (PyList_Check(value)) {
-	linebreak_add_prep(lb, NULL, NULL);
-	len = PyList_Size(value);
-	for (i = 0; i < len; i++) {
-	    item = PyList_GetItem(value, i);	/* borrowed ref. */
-	    if (PyString_Check(item) || PyUnicode_Check(item)) {
-		if ((str = genericstr_ToString(item)) == NULL)
-		    break;
-		else if (strcasecmp(str, "BREAKURI") == 0)
-		    linebreak_add_prep(lb, linebreak_prep_URIBREAK,
-				       Py_True);
-		else if (strcasecmp(str, "NONBREAKURI") == 0)
-		    linebreak_add_prep(lb, linebreak_prep_URIBREAK,
-				       NULL);
-		else {
-		    PyErr_Format(PyExc_ValueError,
-				 "unknown attribute value %200s", str);
+/*
+ * Find the end of paragraph at or after pos and before eot, i.e. the
+ * position next to a mandatory break where state of breaking is fully
+ * reset.  If tailored is true, characters tailored to be mandatory breaks
+ * are also looked for.  If it was not found, eot is returned.
+ */
+static size_t
+breakinput_find_paragraph(linebreak_t * lb, int tailored, breakinput_t * in,
+			  size_t pos, size_t eot)
+{
+    unichar_t c;
+    propval_t lbc;
+
+    for ( ; pos < eot; pos++) {
+	c = breakinput_char(in, pos);
+	/* Lines are broken by only these characters unless tailored. */
+	if (!((0x0A <= c && c <= 0x0D) || c == 0x85 ||
+	      c == 0x2028 || c == 0x2029) &&
+	    !(tailored && linebreak_is_tailored_eop(lb, c)))
+	    continue;
 
-		    free(str);
-		    return -1;
-		}
-		free(str);
-	    } else if (PyTuple_Check(item)) {
-		PyObject *re_module, *patt, *flgs, *func_compile, *args;
+	lbc = linebreak_lbclass(lb, c);
+	if (lbc == LB_BK || lbc == LB_LF || lbc == LB_NL)
+	    return pos + 1;
+	else if (lbc == LB_CR) {
+	    if (pos + 1 < eot &&
+		linebreak_lbclass(lb, breakinput_char(in, pos + 1)) == LB_LF)
+		return pos + 2;
+	    return pos + 1;
+	}
+    }
+    return eot;
+}
 
-		if (PyTuple_Size(item) < 2) {
-		    PyErr_Format(PyExc_ValueError,
-				 "argument size mismatch");
-		    return -1;
-		}
+/*
+ * Break len characters of text from pos dividing them into ranges at the
+ * ends of paragraphs, by up to nthreads native threads.  Result will be
+ * the same as linebreak_break().
+ * If error occurred, exception will be raised and NULL will be returned.
+ * @note linebreak object must not have any Python callbacks.
+ */
+static gcstring_t **
+do_break_parallel(linebreak_t * lb, breakinput_t * in, size_t pos,
+		  size_t len, int nthreads)
+{
+    breakjob_t *jobs = NULL, *j;
+    gcstring_t **ret = NULL;
+    size_t i, njobs, end, eot, minsize, reslen;
+    int tailored = linebreak_has_tailored_eop(lb);
+
+    minsize = len / ((size_t) nthreads * 4);
+    if (minsize < BREAK_PARALLEL_MINSIZE)
+	minsize = BREAK_PARALLEL_MINSIZE;
+
+    eot = pos + len;
+    for (njobs = 0; pos < eot; njobs++, pos = end) {
+	if ((j = PyMem_Realloc(jobs, sizeof(breakjob_t) * (njobs + 1)))
+	    == NULL) {
+	    PyMem_Free(jobs);
+	    PyErr_NoMemory();
+	    return NULL;
+	}
+	jobs = j;
+	if (eot - pos < minsize * 2)
+	    end = eot;
+	else
+	    end = breakinput_find_paragraph(lb, tailored, in,
+						pos + minsize, eot);
+	jobs[njobs].in = in;
+	jobs[njobs].pos = pos;
+	jobs[njobs].len = end - pos;
+    }
 
-		patt = PyTuple_GetItem(item, 0);	/* borrowed ref. */
-		if (PyString_Check(patt) || PyUnicode_Check(patt)) {
-		    re_module = PyImport_ImportModule("re");
-		    func_compile = PyObject_GetAttrString(re_module,
-							  "compile");
-		    Py_INCREF(patt); /* prevent destruction */
-		    if (2 < PyTuple_Size(item)) {
-			flgs = PyTuple_GetItem(item, 2);	/* borrwed */
-			Py_INCREF(flgs);
-		    } else
-			flgs = PyInt_FromLong(0L);
-		    if ((args = Py_BuildValue("(OO)", patt, flgs)) == NULL)
-			return -1;
-		    patt = PyObject_CallObject(func_compile, args);
-		    Py_DECREF(args);
+    if (do_break_many(lb, jobs, njobs, nthreads) != 0) {
+	PyMem_Free(jobs);
+	return NULL;
+    }
 
-		    if (PyTuple_SetItem(item, 0, patt) != 0)
-			return -1;
-		}
-		linebreak_add_prep(lb, prep_func, item);
-	    } else {
-		PyErr_Format(PyExc_TypeError,
-			     "prep argument must be list of tuples, not %200s",
-			     Py_TYPE(item)->tp_name);
-		return -1;
-	    }
+    for (i = 0; i < njobs; i++)
+	if (jobs[i].broken == NULL) {
+	    break_seterror(lb, jobs[i].errnum);
+	    break;
 	}
-    } else {
-	PyErr_Format(PyExc_TypeError,
-		     "prep argument must be list of tuples, not %200s",
-		     Py_TYPE(value)->tp_name);
-	return -1;
+    if (i == njobs && (ret = malloc(sizeof(gcstring_t *))) == NULL)
+	PyErr_NoMemory();
+    else if (i == njobs)
+	ret[0] = NULL;
+    for (i = 0, reslen = 0; i < njobs; i++) {
+	if (jobs[i].broken == NULL)
+	    continue;
+	if (ret != NULL &&
+	    break_result_append(&ret, &reslen, jobs[i].broken) != 0) {
+	    PyErr_NoMemory();
+	    linebreak_free_result(ret, 1);
+	    ret = NULL;
+	}
+	if (ret == NULL)
+	    linebreak_free_result(jobs[i].broken, 1);
     }
-    return 0;
+    PyMem_Free(jobs);
+    return ret;
 }
 
-static int
-LineBreak_set_sizing(PyObject * self, PyObject * value, void *closure)
-{
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+/***
+ *** Callbacks for linebreak library.  For more details see Sombok
+ *** library documentations.
+ ***/
 
-    if (value == NULL)
-	linebreak_set_sizing(lb, NULL, NULL);
-    if (value == Py_None)
-	linebreak_set_sizing(lb, NULL, NULL);
-    else if (PyString_Check(value) || PyUnicode_Check(value)) {
-	char *str;
-	if ((str = genericstr_ToString(value)) == NULL)
-	    return -1;
+/*
+ * Increment/decrement reference count
+ */
+static void
+ref_func(void * obj, int datatype, int d)
+{
+    if (0 < d) {
+	Py_INCREF((PyObject *)obj);
+    } else if (d < 0) {
+	Py_DECREF((PyObject *)obj);
+    }
+}
 
-	if (strcasecmp(str, "UAX11") == 0)
-	    linebreak_set_sizing(lb, linebreak_sizing_UAX11, NULL);
-	else {
-	    PyErr_Format(PyExc_ValueError,
-			 "unknown attribute value %200s", str);
+/*
+ * Call Python callback function with arguments args[1] .. args[nargs - 1].
+ * args[0] will be LineBreak object calling breaking by lb if any,
+ * otherwise new object for lb.
+ */
+static PyObject *
+callback_call(linebreak_t * lb, PyObject * func, PyObject ** args,
+	      size_t nargs)
+{
+    searchctx_t *ctx = searchctx_current();
+    PyObject *self = NULL, *ret;
 
-	    free(str);
-	    return -1;
-	}
-	free(str);
-    } else if (PyFunction_Check(value))
-	linebreak_set_sizing(lb, sizing_func, (void *) value);
+    if (ctx != NULL && ctx->lb == lb && ctx->owner != NULL)
+	args[0] = ctx->owner;	/* borrowed */
     else {
-	PyErr_Format(PyExc_ValueError,
-		     "attribute must be function, not %200s",
-		     Py_TYPE(value)->tp_name);
-	return -1;
+	linebreak_incref(lb);	/* prevent destruction */
+	if ((self = LineBreak_FromCstruct(STASH_TYPE(lb), lb)) == NULL) {
+	    linebreak_destroy(lb);
+	    return NULL;
+	}
+	args[0] = self;
     }
-    return 0;
+    ret = PyObject_Vectorcall(func, args, nargs, NULL);
+    Py_XDECREF(self);
+    return ret;
 }
 
-static int
-LineBreak_set_urgent(PyObject * self, PyObject * value, void *closure)
+/*
+ * Make view of grapheme cluster string passed to Python callback.  It is
+ * released by GCStr_ReleaseView() when callback returned.
+ */
+#define callback_gcstr(lb, gcstr) \
+    GCStr_View(STASH_GCSTRTYPE(lb), (lb), (gcstr))
+
+/*
+ * Call preprocessing function
+ * @note Python callback may return list of broken text or single text.
+ */
+static gcstring_t *
+prep_func(linebreak_t * lb, void *data, unistr_t * str, unistr_t * text)
 {
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    PyObject *rx = NULL, *func = NULL, *pyret, *pyobj, *args[2];
+    int count, i, j;
+    gcstring_t *gcstr, *ret;
 
-    if (value == NULL)
-	linebreak_set_urgent(lb, NULL, NULL);
-    else if (value == Py_None)
-	linebreak_set_urgent(lb, NULL, NULL);
-    else if (PyString_Check(value) || PyUnicode_Check(value)) {
-	char *str;
+    /* Pass I */
 
-	if ((str = genericstr_ToString(value)) == NULL)
-	    return -1;
-	else if (strcasecmp(str, "FORCE") == 0)
-	    linebreak_set_urgent(lb, linebreak_urgent_FORCE, NULL);
-	else if (strcasecmp(str, "RAISE") == 0)
-	    linebreak_set_urgent(lb, linebreak_urgent_ABORT, NULL);
-	else {
-	    PyErr_Format(PyExc_ValueError,
-			 "unknown attribute value %200s", str);
+    if (text != NULL) {
+	if ((rx = PyTuple_GetItem(data, 0)) == NULL) {
+	    lb->errnum = EINVAL;
+	    return NULL;
+	}
+	do_re_search_once(searchctx_current(), rx, str, text);
+	return NULL;
+    }
 
-	    free(str);
-	    return -1;
+    /* Pass II */
+
+    if ((func = PyTuple_GetItem(data, 1)) == NULL) {
+	if ((ret = gcstring_newcopy(str, lb)) == NULL) {
+	    lb->errnum = errno ? errno : ENOMEM;
+	    return NULL;
 	}
-	free(str);
-    } else if (PyFunction_Check(value))
-	linebreak_set_urgent(lb, urgent_func, (void *) value);
-    else {
-	PyErr_Format(PyExc_ValueError,
-		     "attribute must be list, not %200s",
-		     Py_TYPE(value)->tp_name);
-	return -1;
+	return ret;
     }
-    return 0;
+
+    if ((args[1] = unicode_FromCstruct(str)) == NULL) {
+	lb->errnum = LINEBREAK_EEXTN;
+	return NULL;
+    }
+    pyret = callback_call(lb, func, args, 2);
+    Py_DECREF(args[1]);
+    if (PyErr_Occurred()) {
+	if (!lb->errnum)
+	    lb->errnum = LINEBREAK_EEXTN;
+	return NULL;
+    }
+    if (pyret == NULL)
+	return NULL;
+
+    if (PyList_Check(pyret)) {
+	if ((ret = gcstring_new(NULL, lb)) == NULL)
+	    return (lb->errnum = errno ? errno : ENOMEM), NULL;
+
+	count = PyList_Size(pyret);
+	for (i = 0; i < count; i++) {
+	    pyobj = PyList_GetItem(pyret, i);	/* borrowed ref. */
+	    if (pyobj == Py_None)
+		continue;
+	    else if (GCStr_Check(pyobj))
+		gcstr = gcstring_copy(GCStr_AS_CSTRUCT(pyobj));
+	    else
+		gcstr = genericstr_ToCstruct(pyobj, lb);
+	    if (gcstr == NULL) {
+		if (!lb->errnum)
+		    lb->errnum = errno ? errno : LINEBREAK_EEXTN;
+
+		Py_DECREF(pyret);
+		return NULL;
+	    }
+
+	    for (j = 0; j < gcstr->gclen; j++) {
+		if (gcstr->gcstr[j].flag &
+		    (LINEBREAK_FLAG_ALLOW_BEFORE |
+		     LINEBREAK_FLAG_PROHIBIT_BEFORE))
+		    continue;
+		if (0 < i && j == 0)
+		    gcstr->gcstr[j].flag |= LINEBREAK_FLAG_ALLOW_BEFORE;
+		else if (0 < j)
+		    gcstr->gcstr[j].flag |= LINEBREAK_FLAG_PROHIBIT_BEFORE;
+	    }
+
+	    gcstring_append(ret, gcstr);
+	    gcstring_destroy(gcstr);
+	}
+	Py_DECREF(pyret);
+	return ret;
+    }
+
+    if (pyret == Py_None) {
+	Py_DECREF(pyret);
+	return NULL;
+    }
+
+    if (GCStr_Check(pyret))
+	ret = gcstring_copy(GCStr_AS_CSTRUCT(pyret));
+    else
+	ret = genericstr_ToCstruct(pyret, lb);
+    if (ret == NULL) {
+	if (!lb->errnum)
+	    lb->errnum = LINEBREAK_EEXTN;
+
+	Py_DECREF(pyret);
+	return NULL;
+    }
+    Py_DECREF(pyret);
+
+    for (j = 0; j < ret->gclen; j++) {
+	if (ret->gcstr[j].flag &
+	    (LINEBREAK_FLAG_ALLOW_BEFORE | LINEBREAK_FLAG_PROHIBIT_BEFORE))
+	    continue;
+	if (0 < j)
+	    ret->gcstr[j].flag |= LINEBREAK_FLAG_PROHIBIT_BEFORE;
+    }
+
+    return ret;
 }
 
-_set_Boolean(virama_as_joiner, LINEBREAK_OPTION_VIRAMA_AS_JOINER)
+/*
+ * Call format function
+ */
+static char *linebreak_states[] = {
+    NULL, "sot", "sop", "sol", "", "eol", "eop", "eot", NULL
+};
+static PyObject *linebreak_state_objs[LINEBREAK_STATE_MAX];
+static gcstring_t *
+format_func(linebreak_t * lb, linebreak_state_t action, gcstring_t * str)
+{
+    PyObject *func, *args[3], *pyret;
+    gcstring_t *gcstr;
 
-static PyGetSetDef LineBreak_getseters[] = {
-    /* undocumented attributes */
-    {"linebreakType",
-     NULL,
+    func = (PyObject *) lb->format_data;
+    if (func == NULL)
+	return NULL;
+
+    if (action <= LINEBREAK_STATE_NONE || LINEBREAK_STATE_MAX <= action)
+	return NULL;
+    if (linebreak_state_objs[action] == NULL &&
+	(linebreak_state_objs[action] =
+	 PyString_FromString(linebreak_states[(size_t) action])) == NULL) {
+	lb->errnum = LINEBREAK_EEXTN;
+	return NULL;
+    }
+
+    args[1] = linebreak_state_objs[action];	/* borrowed */
+    if ((args[2] = callback_gcstr(lb, str)) == NULL) {
+	lb->errnum = LINEBREAK_EEXTN;
+	return NULL;
+    }
+    pyret = callback_call(lb, func, args, 3);
+
+    if (GCStr_ReleaseView(args[2]) != 0 || PyErr_Occurred()) {
+	if (!lb->errnum)
+	    lb->errnum = LINEBREAK_EEXTN;
+	if (pyret != NULL) {
+	    Py_DECREF(pyret);
+	}
+	return NULL;
+    }
+    if (pyret == NULL)
+	return NULL;
+
+    if (pyret == Py_None) {
+	Py_DECREF(pyret);
+	return NULL;
+    }
+
+    if (GCStr_Check(pyret))
+	gcstr = gcstring_copy(GCStr_AS_CSTRUCT(pyret));
+    else if ((gcstr = genericstr_ToCstruct(pyret, lb)) == NULL) {
+	if (!lb->errnum)
+	    lb->errnum = errno ? errno : ENOMEM;
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+	Py_DECREF(pyret);
+	return NULL;
+    }
+    Py_DECREF(pyret);
+    return gcstr;
+}
+
+/*
+ * Call sizing function
+ */
+static double
+sizing_func(linebreak_t * lb, double len,
+	    gcstring_t * pre, gcstring_t * spc, gcstring_t * str)
+{
+    PyObject *func, *args[5], *pyret;
+    double ret;
+    int i, err;
+
+    func = (PyObject *) lb->sizing_data;
+    if (func == NULL)
+	return -1.0;
+
+    args[1] = PyFloat_FromDouble(len);
+    args[2] = callback_gcstr(lb, pre);
+    args[3] = callback_gcstr(lb, spc);
+    args[4] = callback_gcstr(lb, str);
+    if (args[1] == NULL || args[2] == NULL || args[3] == NULL ||
+	args[4] == NULL) {
+	Py_XDECREF(args[1]);
+	for (i = 2; i < 5; i++)
+	    if (args[i] != NULL)
+		GCStr_ReleaseView(args[i]);
+	lb->errnum = LINEBREAK_EEXTN;
+	return -1.0;
+    }
+    pyret = callback_call(lb, func, args, 5);
+    Py_DECREF(args[1]);
+    for (i = 2, err = 0; i < 5; i++)
+	if (GCStr_ReleaseView(args[i]) != 0)
+	    err = 1;
+
+    if (err || PyErr_Occurred()) {
+	if (!lb->errnum)
+	    lb->errnum = LINEBREAK_EEXTN;
+	if (pyret != NULL) {
+	    Py_DECREF(pyret);
+	}
+	return -1.0;
+    }
+
+    ret = PyFloat_AsDouble(pyret);
+    if (PyErr_Occurred()) {
+	if (!lb->errnum)
+	    lb->errnum = LINEBREAK_EEXTN;
+	Py_DECREF(pyret);
+	return -1.0;
+    }
+    Py_DECREF(pyret);
+
+    return ret;
+}
+
+/*
+ * Call urgent breaking function
+ */
+static gcstring_t *
+urgent_func(linebreak_t * lb, gcstring_t * str)
+{
+    PyObject *func, *args[2], *pyret, *pyobj;
+    size_t count, i;
+    gcstring_t *gcstr, *ret;
+
+    func = (PyObject *) lb->urgent_data;
+    if (func == NULL)
+	return NULL;
+
+    if ((args[1] = callback_gcstr(lb, str)) == NULL) {
+	lb->errnum = LINEBREAK_EEXTN;
+	return NULL;
+    }
+    pyret = callback_call(lb, func, args, 2);
+
+    if (GCStr_ReleaseView(args[1]) != 0 || PyErr_Occurred()) {
+	if (!lb->errnum)
+	    lb->errnum = LINEBREAK_EEXTN;
+	if (pyret != NULL) {
+	    Py_DECREF(pyret);
+	}
+	return NULL;
+    }
+    if (pyret == NULL)
+	return NULL;
+
+    if (pyret == Py_None) {
+	Py_DECREF(pyret);
+	return NULL;
+    }
+
+    if (!PyList_Check(pyret)) {
+	if (GCStr_Check(pyret))
+	    ret = gcstring_copy(GCStr_AS_CSTRUCT(pyret));
+	else
+	    ret = genericstr_ToCstruct(pyret, lb);
+	Py_DECREF(pyret);
+	return ret;
+    }
+
+    ret = gcstring_new(NULL, lb);
+    count = PyList_Size(pyret);
+    for (i = 0; i < count; i++) {
+	pyobj = PyList_GetItem(pyret, i);	/* borrowed ref. */
+	if (pyobj == Py_None)
+	    continue;
+	else if (GCStr_Check(pyobj))
+	    gcstr = gcstring_copy(GCStr_AS_CSTRUCT(pyobj));
+	else
+	    gcstr = genericstr_ToCstruct(pyobj, lb);
+	if (gcstr == NULL) {
+	    if (!lb->errnum)
+		lb->errnum = errno ? errno : LINEBREAK_EEXTN;
+
+	    Py_DECREF(pyret);
+	    return NULL;
+	}
+
+	if (gcstr->gclen)
+	    gcstr->gcstr[0].flag = LINEBREAK_FLAG_ALLOW_BEFORE;
+	gcstring_append(ret, gcstr);
+	gcstring_destroy(gcstr);
+    }
+
+    Py_DECREF(pyret);
+    return ret;
+}
+
+/*** 
+ *** Python module definitions
+ ***/
+
+/**
+ ** Exceptions
+ **/
+
+static PyObject *LineBreakException;
+
+/**
+ ** LineBreak class
+ **/
+
+/*
+ * Constructor & Destructor
+ */
+
+static void
+LineBreak_dealloc(LineBreakObject * self)
+{
+    TDictObject * tdict;
+
+    /* remove linkage to tailoring dictionaries */
+    for (tdict = self->tdict; tdict != NULL; tdict = tdict->next)
+	tdict->lb = NULL;
+
+    if (self->nshare != NULL && --*self->nshare == 0)
+	free(self->nshare);
+    linebreak_destroy(LineBreak_AS_CSTRUCT(self));
+    Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *
+LineBreak_subtype_new(PyTypeObject *, PyObject *, PyObject *);
+
+static PyObject *
+LineBreak_new(PyTypeObject * type, PyObject * args, PyObject * kwds)
+{
+    LineBreakObject *self;
+    PyObject *stash;
+
+    if (type != &LineBreak_Type)
+        return LineBreak_subtype_new(type, args, kwds);
+
+    if ((self = (LineBreakObject *) type->tp_alloc(type, 0)) == NULL)
+	return NULL;
+
+    if ((self->obj = linebreak_new(ref_func)) == NULL) {
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+	Py_DECREF(self);
+	return NULL;
+    }
+
+    /*
+     * stash is a tuple of
+     * (<dict>, <LineBreak type>, <GCStr type>, <Exception type>).
+     * <dict> is used by mapping methods.  Others are type of Python 
+     * objects used in the callback functions.
+     */
+    Py_INCREF(&LineBreak_Type);
+    Py_INCREF(&GCStr_Type);
+    Py_INCREF(LineBreakException);
+    if ((stash = Py_BuildValue("({}OOO)",
+			       (PyObject *)&LineBreak_Type,
+			       (PyObject *)&GCStr_Type,
+			       LineBreakException)) == NULL) {
+	Py_DECREF(self);
+	return NULL;
+    }
+
+    linebreak_set_stash(self->obj, stash);
+    Py_DECREF(stash);		/* fixup */
+
+    /* tailoring dictionary */
+    self->tdict = NULL;
+    /* not shared */
+    self->nshare = NULL;
+    self->tabsize = DEFAULT_TABSIZE;
+
+    return (PyObject *) self;
+}
+
+static PyObject *
+LineBreak_subtype_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *tmp, *newobj;
+
+    assert(PyType_IsSubtype(type, &LineBreak_Type));
+    if ((tmp = LineBreak_new(&LineBreak_Type, args, kwds)) == NULL)
+	return NULL;
+    assert(LineBreak_CheckExact(tmp));
+    if ((newobj = type->tp_alloc(type, 0)) == NULL) {
+	Py_DECREF(tmp);
+	return NULL;
+    }
+    LineBreak_AS_CSTRUCT(newobj) = LineBreak_AS_CSTRUCT(tmp);
+    ((LineBreakObject *) newobj)->tabsize =
+	((LineBreakObject *) tmp)->tabsize;
+    LineBreak_AS_CSTRUCT(tmp) = NULL;
+    Py_DECREF(tmp);
+    return newobj;
+}
+
+static PyGetSetDef LineBreak_getseters[];
+
+static int
+LineBreak_init(LineBreakObject * self, PyObject * args, PyObject * kwds)
+{
+    PyObject *key, *value;
+    Py_ssize_t pos;
+    PyGetSetDef *getset;
+    char *keystr;
+
+    if (kwds == NULL)
+	return 0;
+    if (LineBreak_Unshare((PyObject *) self) != 0)
+	return -1;
+
+    pos = 0;
+    while (PyDict_Next(kwds, &pos, &key, &value)) {
+	if ((keystr = genericstr_ToString(key)) == NULL)
+	    return -1;
+	for (getset = LineBreak_getseters; getset->name != NULL; getset++) {
+	    if (getset->set == NULL)
+		continue;
+	    if (strcmp(getset->name, keystr) != 0)
+		continue;
+	    if ((getset->set) ((PyObject *) self, value, NULL) != 0) {
+		free(keystr);
+		return -1;
+	    }
+	    break;
+	}
+	if (getset->name == NULL) {
+	    PyErr_Format(PyExc_ValueError, "invalid argument '%s'", keystr);
+	    free(keystr);
+	    return -1;
+	}
+	free(keystr);
+    }
+    return 0;
+}
+
+/*
+ * Attribute methods
+ */
+
+static PyObject * TDict_FromLineBreak(PyObject *, tdicttype);
+
+#define _get_Boolean(name, bit) \
+    static PyObject * \
+    LineBreak_get_##name(PyObject *self) \
+    { \
+        PyObject *val; \
+    \
+        val = (LineBreak_AS_CSTRUCT(self)->options & bit) ? \
+              Py_True : Py_False; \
+        Py_INCREF(val); \
+        return val; \
+    }
+
+_get_Boolean(break_indent, LINEBREAK_OPTION_BREAK_INDENT)
+
+static PyObject *
+LineBreak_get_charmax(PyObject * self)
+{
+    return PyInt_FromSsize_t(LineBreak_AS_CSTRUCT(self)->charmax);
+}
+
+static PyObject *
+LineBreak_get_width(PyObject * self)
+{
+    return PyFloat_FromDouble(format_get_width(LineBreak_AS_CSTRUCT(self)));
+}
+
+static PyObject *
+LineBreak_get_minwidth(PyObject * self)
+{
+    return PyFloat_FromDouble(LineBreak_AS_CSTRUCT(self)->colmin);
+}
+
+_get_Boolean(complex_breaking, LINEBREAK_OPTION_COMPLEX_BREAKING)
+
+_get_Boolean(eastasian_context, LINEBREAK_OPTION_EASTASIAN_CONTEXT)
+
+static PyObject *
+LineBreak_get_eaw(PyObject * self)
+{
+    return TDict_FromLineBreak(self, TDICT_EAW);
+}
+
+static PyObject *
+LineBreak_get_format(PyObject * self)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    PyObject *val;
+
+    if (lb->format_func == NULL) {
+	Py_RETURN_NONE;
+    } else if (lb->format_func == linebreak_format_NEWLINE)
+	val = TEXTSEG_NEWLINE;
+    else if (lb->format_func == linebreak_format_SIMPLE)
+	val = TEXTSEG_SIMPLE;
+    else if (lb->format_func == linebreak_format_TRIM)
+	val = TEXTSEG_TRIM;
+    else if (lb->format_func == format_FIXED)
+	val = TEXTSEG_FIXED;
+    else if (lb->format_func == format_FLOWED)
+	val = TEXTSEG_FLOWED;
+    else if (lb->format_func == format_func)
+	val = (PyObject *) lb->format_data;
+    else {
+	PyErr_Format(PyExc_RuntimeError, "internal error");
+	return NULL;
+    }
+    Py_INCREF(val);
+    return val;
+}
+
+_get_Boolean(hangul_as_al, LINEBREAK_OPTION_HANGUL_AS_AL)
+
+static PyObject *
+LineBreak_get_lbc(PyObject * self)
+{
+    return TDict_FromLineBreak(self, TDICT_LBC);
+}
+
+_get_Boolean(legacy_cm, LINEBREAK_OPTION_LEGACY_CM)
+
+static PyObject *
+LineBreak_get_newline(PyObject * self)
+{
+    return unicode_FromCstruct(&(LineBreak_AS_CSTRUCT(self)->newline));
+}
+
+static PyObject *
+LineBreak_get_prep(PyObject * self)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    PyObject *val;
+
+    if (lb->prep_func == NULL || lb->prep_func[0] == NULL) {
+	val = Py_None;
+	Py_INCREF(val);
+    } else {
+	size_t i;
+	PyObject *v;
+	val = PyList_New(0);
+	for (i = 0; lb->prep_func[i] != NULL; i++) {
+	    if (lb->prep_func[i] == linebreak_prep_URIBREAK) {
+		if (lb->prep_data == NULL || lb->prep_data[i] == NULL)
+		    v = TEXTSEG_NONBREAKURI;
+		else
+		    v = TEXTSEG_BREAKURI;
+	    } else if (lb->prep_data == NULL || lb->prep_data[i] == NULL) {
+		v = Py_None;
+	    } else {
+		v = lb->prep_data[i];
+	    }
+	    /* Py_INCREF(v) */
+	    PyList_Append(val, v);
+	}
+    }
+    return val;
+}
+
+static PyObject *
+LineBreak_get_sizing(PyObject * self)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    PyObject *val;
+
+    if (lb->sizing_func == NULL) {
+	Py_RETURN_NONE;
+    } else if (lb->sizing_func == linebreak_sizing_UAX11)
+	val = TEXTSEG_UAX11;
+    else if (lb->sizing_func == sizing_UAX11_TABS)
+	val = TEXTSEG_UAX11_TABS;
+    else if (lb->sizing_func == sizing_func)
+	val = (PyObject *) lb->sizing_data;
+    else {
+	PyErr_Format(PyExc_RuntimeError, "internal error");
+	return NULL;
+    }
+    Py_INCREF(val);
+
+    return val;
+}
+
+static PyObject *
+LineBreak_get_tabsize(PyObject * self)
+{
+    return PyFloat_FromDouble(((LineBreakObject *) self)->tabsize);
+}
+
+static PyObject *
+LineBreak_get_urgent(PyObject * self)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    PyObject *val;
+
+    if (lb->urgent_func == NULL) {
+	Py_RETURN_NONE;
+    } else if (lb->urgent_func == linebreak_urgent_ABORT)
+	val = TEXTSEG_RAISE;
+    else if (lb->urgent_func == linebreak_urgent_FORCE)
+	val = TEXTSEG_FORCE;
+    else if (lb->urgent_func == urgent_func) {
+	val = (PyObject *) lb->urgent_data;
+    } else {
+	PyErr_Format(PyExc_RuntimeError, "internal error");
+	return NULL;
+    }
+
+    Py_INCREF(val);
+    return val;
+}
+
+_get_Boolean(virama_as_joiner, LINEBREAK_OPTION_VIRAMA_AS_JOINER)
+
+#define _set_Boolean(name, bit) \
+    static int \
+    LineBreak_set_##name(PyObject *self, PyObject *arg, void *closure) \
+    { \
+        linebreak_t *lb = LineBreak_AS_CSTRUCT(self); \
+        long ival; \
+    \
+        if (arg == NULL) { \
+	    PyErr_Format(PyExc_NotImplementedError, \
+		         "Can not delete attribute"); \
+	    return -1; \
+        } \
+    \
+        ival = PyInt_AsLong(arg); \
+        if (PyErr_Occurred()) \
+	    return -1; \
+        if (ival) \
+	    lb->options |= bit; \
+        else \
+	    lb->options &= ~bit; \
+	return 0; \
+    }
+
+static int tdict_update(PyObject *, PyObject *, int);
+
+static int
+LineBreak_set_linebreakType(PyObject * self, PyObject * value, void *closure)
+{
+    if (! PyType_Check(value)) {
+	PyErr_Format(PyExc_ValueError, "expected type object, %200s found",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    if (! PyType_IsSubtype((PyTypeObject *)value, &LineBreak_Type)) {
+	PyErr_Format(PyExc_ValueError, "expected LineBreak type, %200s found",
+		     ((PyTypeObject *)value)->tp_name);
+	return -1;
+    }
+    Py_INCREF(value);	/* ref. to be stolen */
+    if (PyTuple_SetItem(LineBreak_AS_CSTRUCT(self)->stash, 1, value) != 0)
+	return -1;
+    return 0;
+}
+
+static int
+LineBreak_set_gcstrType(PyObject * self, PyObject * value, void *closure)
+{
+    if (! PyType_Check(value)) {
+	PyErr_Format(PyExc_ValueError, "expected type object, %200s found",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    if (! PyType_IsSubtype((PyTypeObject *)value, &GCStr_Type)) {
+	PyErr_Format(PyExc_ValueError, "expected GCStr type, %200s found",
+		     ((PyTypeObject *)value)->tp_name);
+	return -1;
+    }
+    Py_INCREF(value);	/* ref. to be stolen */
+    if (PyTuple_SetItem(LineBreak_AS_CSTRUCT(self)->stash, 2, value) != 0)
+	return -1;
+    return 0;
+}
+
+static int
+LineBreak_set_exceptionType(PyObject * self, PyObject * value, void *closure)
+{
+    if (! PyType_Check(value)) {
+	PyErr_Format(PyExc_ValueError, "expected type object, %200s found",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    if (! PyType_IsSubtype((PyTypeObject *)value,
+			   (PyTypeObject *)PyExc_Exception)) {
+	PyErr_Format(PyExc_ValueError, "expected Exception type, %200s found",
+		     ((PyTypeObject *)value)->tp_name);
+	return -1;
+    }
+    Py_INCREF(value);	/* ref. to be stolen */
+    if (PyTuple_SetItem(LineBreak_AS_CSTRUCT(self)->stash, 3, value) != 0)
+	return -1;
+    return 0;
+}
+
+_set_Boolean(break_indent, LINEBREAK_OPTION_BREAK_INDENT)
+
+static int
+LineBreak_set_charmax(PyObject * self, PyObject * value, void *closure)
+{
+    long ival;
+
+    if (value == NULL) {
+	PyErr_Format(PyExc_NotImplementedError,
+		     "Can not delete attribute");
+	return -1;
+    }
+    if (PyInt_Check(value))
+	ival = (long) PyInt_AsLong(value);
+    else if (PyLong_Check(value))
+	ival = PyInt_AsLong(value);
+    else {
+	PyErr_Format(PyExc_TypeError,
+		     "attribute must be non-negative integer, not %200s",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    if (ival < 0) {
+	PyErr_Format(PyExc_ValueError,
+		     "attribute must be non-negative integer, not %ld",
+		     ival);
+	return -1;
+    }
+    LineBreak_AS_CSTRUCT(self)->charmax = ival;
+    return 0;
+}
+
+static int
+LineBreak_set_width(PyObject * self, PyObject * value, void *closure)
+{
+    double dval;
+
+    if (value == NULL) {
+	PyErr_Format(PyExc_NotImplementedError,
+		     "Can not delete attribute");
+	return -1;
+    }
+    if (PyInt_Check(value))
+	dval = (double) PyInt_AsLong(value);
+    else if (PyLong_Check(value))
+	dval = (double) PyInt_AsLong(value);
+    else if (PyFloat_Check(value))
+	dval = PyFloat_AsDouble(value);
+    else {
+	PyErr_Format(PyExc_TypeError,
+		     "attribute must be non-negative real number, not %200s",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    if (dval < 0.0) {
+	PyErr_Format(PyExc_ValueError,
+		     "attribute must be non-negative real number, not %f",
+		     dval);
+	return -1;
+    }
+    format_set_width(LineBreak_AS_CSTRUCT(self), dval);
+    return 0;
+}
+
+static int
+LineBreak_set_minwidth(PyObject * self, PyObject * value, void *closure)
+{
+    double dval;
+
+    if (value == NULL) {
+	PyErr_Format(PyExc_NotImplementedError,
+		     "Can not delete attribute");
+	return -1;
+    }
+    if (PyInt_Check(value))
+	dval = (double) PyInt_AsLong(value);
+    else if (PyLong_Check(value))
+	dval = (double) PyInt_AsLong(value);
+    else if (PyFloat_Check(value))
+	dval = PyFloat_AsDouble(value);
+    else {
+	PyErr_Format(PyExc_TypeError,
+		     "attribute must be non-negative real number, not %200s",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    if (dval < 0.0) {
+	PyErr_Format(PyExc_ValueError,
+		     "attribute must be non-negative real number, not %f",
+		     dval);
+	return -1;
+    }
+    LineBreak_AS_CSTRUCT(self)->colmin = dval;
+    return 0;
+}
+
+_set_Boolean(complex_breaking, LINEBREAK_OPTION_COMPLEX_BREAKING)
+
+_set_Boolean(eastasian_context, LINEBREAK_OPTION_EASTASIAN_CONTEXT)
+
+static int
+LineBreak_set_eaw(PyObject * self, PyObject * value, void *closure)
+{
+    PyObject *tdict;
+    int result = 0;
+
+    if (value == NULL) {
+	PyErr_SetString(PyExc_AttributeError, "cannot remove attribute");
+	return -1;
+    }
+    if ((tdict = TDict_FromLineBreak(self, TDICT_EAW)) == NULL)
+	return -1;
+    result = tdict_update(tdict, value, 1);
+    Py_DECREF(tdict);
+    return result;
+}
+
+static int
+LineBreak_set_format(PyObject * self, PyObject * value, void *closure)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+
+    /* Width changed by previous format is restored. */
+    lb->colmax = format_get_width(lb);
+    if (value == NULL)
+	linebreak_set_format(lb, NULL, NULL);
+    else if (value == Py_None)
+	linebreak_set_format(lb, NULL, NULL);
+    else if (PyString_Check(value) || PyUnicode_Check(value)) {
+	char *str;
+	if ((str = genericstr_ToString(value)) == NULL)
+	    return -1;
+
+	if (strcasecmp(str, "SIMPLE") == 0)
+	    linebreak_set_format(lb, linebreak_format_SIMPLE, NULL);
+	else if (strcasecmp(str, "NEWLINE") == 0)
+	    linebreak_set_format(lb, linebreak_format_NEWLINE, NULL);
+	else if (strcasecmp(str, "TRIM") == 0)
+	    linebreak_set_format(lb, linebreak_format_TRIM, NULL);
+	else if (strcasecmp(str, "FIXED") == 0 ||
+		 strcasecmp(str, "FLOWED") == 0) {
+	    if (format_set_state(lb, (strcasecmp(str, "FIXED") == 0) ?
+				 format_FIXED : format_FLOWED, NULL) != 0) {
+		free(str);
+		return -1;
+	    }
+	} else {
+	    PyErr_Format(PyExc_ValueError,
+			 "unknown attribute value, %200s", str);
+
+	    free(str);
+	    return -1;
+	}
+	free(str);
+    } else if (PyFunction_Check(value))
+	linebreak_set_format(lb, format_func, (void *) value);
+    else {
+	PyErr_Format(PyExc_ValueError,
+		     "attribute must be list, not %200s",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    return 0;
+}
+
+_set_Boolean(hangul_as_al, LINEBREAK_OPTION_HANGUL_AS_AL)
+
+static int
+LineBreak_set_lbc(PyObject * self, PyObject * value, void *closure)
+{
+    PyObject *tdict;
+    int result = 0;
+
+    if (value == NULL) {
+	PyErr_SetString(PyExc_AttributeError, "cannot remove attribute");
+	return -1;
+    }
+    if ((tdict = TDict_FromLineBreak(self, TDICT_LBC)) == NULL)
+        return -1;
+    result = tdict_update(tdict, value, 1);
+    Py_DECREF(tdict);
+    return result;
+}
+
+_set_Boolean(legacy_cm, LINEBREAK_OPTION_LEGACY_CM)
+
+static int
+LineBreak_set_newline(PyObject * self, PyObject * value, void *closure)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    unistr_t unistr = { NULL, 0 };
+
+    if (value == NULL)
+	linebreak_set_newline(lb, &unistr);
+    else if (value == Py_None)
+	linebreak_set_newline(lb, &unistr);
+    else {
+	if (unicode_ToCstruct(&unistr, value) == NULL)
+	    return -1;
+	linebreak_set_newline(lb, &unistr);
+	free(unistr.str);
+    }
+    return 0;
+}
+
+static int
+LineBreak_set_prep(PyObject * self, PyObject * value, void *closure)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    Py_ssize_t i, len;
+    PyObject *item;
+    char *str;
+
+    if (value == NULL)
+	linebreak_add_prep(lb, NULL, NULL);
+    else if (value == Py_None)
+	linebreak_add_prep(lb, NULL, NULL);
+    else if (PyList_Check(value)) {
+	linebreak_add_prep(lb, NULL, NULL);
+	len = PyList_Size(value);
+	for (i = 0; i < len; i++) {
+	    item = PyList_GetItem(value, i);	/* borrowed ref. */
+	    if (PyString_Check(item) || PyUnicode_Check(item)) {
+		if ((str = genericstr_ToString(item)) == NULL)
+		    break;
+		else if (strcasecmp(str, "BREAKURI") == 0)
+		    linebreak_add_prep(lb, linebreak_prep_URIBREAK,
+				       Py_True);
+		else if (strcasecmp(str, "NONBREAKURI") == 0)
+		    linebreak_add_prep(lb, linebreak_prep_URIBREAK,
+				       NULL);
+		else {
+		    PyErr_Format(PyExc_ValueError,
+				 "unknown attribute value %200s", str);
+
+		    free(str);
+		    return -1;
+		}
+		free(str);
+	    } else if (PyTuple_Check(item)) {
+		PyObject *re_module, *patt, *flgs, *func_compile, *args;
+
+		if (PyTuple_Size(item) < 2) {
+		    PyErr_Format(PyExc_ValueError,
+				 "argument size mismatch");
+		    return -1;
+		}
+
+		patt = PyTuple_GetItem(item, 0);	/* borrowed ref. */
+		if (PyString_Check(patt) || PyUnicode_Check(patt)) {
+		    re_module = PyImport_ImportModule("re");
+		    func_compile = PyObject_GetAttrString(re_module,
+							  "compile");
+		    Py_INCREF(patt); /* prevent destruction */
+		    if (2 < PyTuple_Size(item)) {
+			flgs = PyTuple_GetItem(item, 2);	/* borrwed */
+			Py_INCREF(flgs);
+		    } else
+			flgs = PyInt_FromLong(0L);
+		    if ((args = Py_BuildValue("(OO)", patt, flgs)) == NULL)
+			return -1;
+		    patt = PyObject_CallObject(func_compile, args);
+		    Py_DECREF(args);
+
+		    if (PyTuple_SetItem(item, 0, patt) != 0)
+			return -1;
+		}
+		linebreak_add_prep(lb, prep_func, item);
+	    } else {
+		PyErr_Format(PyExc_TypeError,
+			     "prep argument must be list of tuples, not %200s",
+			     Py_TYPE(item)->tp_name);
+		return -1;
+	    }
+	}
+    } else {
+	PyErr_Format(PyExc_TypeError,
+		     "prep argument must be list of tuples, not %200s",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    return 0;
+}
+
+static int
+LineBreak_set_sizing(PyObject * self, PyObject * value, void *closure)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+
+    if (value == NULL)
+	linebreak_set_sizing(lb, NULL, NULL);
+    if (value == Py_None)
+	linebreak_set_sizing(lb, NULL, NULL);
+    else if (PyString_Check(value) || PyUnicode_Check(value)) {
+	char *str;
+	if ((str = genericstr_ToString(value)) == NULL)
+	    return -1;
+
+	if (strcasecmp(str, "UAX11") == 0)
+	    linebreak_set_sizing(lb, linebreak_sizing_UAX11, NULL);
+	else if (strcasecmp(str, "UAX11_TABS") == 0) {
+	    PyObject *tabsize;
+
+	    if ((tabsize = PyFloat_FromDouble(((LineBreakObject *) self)->
+					      tabsize)) == NULL) {
+		free(str);
+		return -1;
+	    }
+	    linebreak_set_sizing(lb, sizing_UAX11_TABS, (void *) tabsize);
+	    Py_DECREF(tabsize);	/* fixup */
+	} else {
+	    PyErr_Format(PyExc_ValueError,
+			 "unknown attribute value %200s", str);
+
+	    free(str);
+	    return -1;
+	}
+	free(str);
+    } else if (PyFunction_Check(value))
+	linebreak_set_sizing(lb, sizing_func, (void *) value);
+    else {
+	PyErr_Format(PyExc_ValueError,
+		     "attribute must be function, not %200s",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    return 0;
+}
+
+static int
+LineBreak_set_tabsize(PyObject * self, PyObject * value, void *closure)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    PyObject *tabsize;
+    double dval;
+
+    if (value == NULL) {
+	PyErr_Format(PyExc_NotImplementedError,
+		     "Can not delete attribute");
+	return -1;
+    }
+    if (PyInt_Check(value))
+	dval = (double) PyInt_AsLong(value);
+    else if (PyLong_Check(value))
+	dval = (double) PyInt_AsLong(value);
+    else if (PyFloat_Check(value))
+	dval = PyFloat_AsDouble(value);
+    else {
+	PyErr_Format(PyExc_TypeError,
+		     "attribute must be non-negative real number, not %200s",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    if (dval < 0.0) {
+	PyErr_Format(PyExc_ValueError,
+		     "attribute must be non-negative real number, not %f",
+		     dval);
+	return -1;
+    }
+
+    ((LineBreakObject *) self)->tabsize = dval;
+    /* Sizing method is kept as it is. */
+    if (lb->sizing_func == sizing_UAX11_TABS) {
+	if ((tabsize = PyFloat_FromDouble(dval)) == NULL)
+	    return -1;
+	linebreak_set_sizing(lb, sizing_UAX11_TABS, (void *) tabsize);
+	Py_DECREF(tabsize);	/* fixup */
+    }
+    return 0;
+}
+
+static int
+LineBreak_set_urgent(PyObject * self, PyObject * value, void *closure)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+
+    if (value == NULL)
+	linebreak_set_urgent(lb, NULL, NULL);
+    else if (value == Py_None)
+	linebreak_set_urgent(lb, NULL, NULL);
+    else if (PyString_Check(value) || PyUnicode_Check(value)) {
+	char *str;
+
+	if ((str = genericstr_ToString(value)) == NULL)
+	    return -1;
+	else if (strcasecmp(str, "FORCE") == 0)
+	    linebreak_set_urgent(lb, linebreak_urgent_FORCE, NULL);
+	else if (strcasecmp(str, "RAISE") == 0)
+	    linebreak_set_urgent(lb, linebreak_urgent_ABORT, NULL);
+	else {
+	    PyErr_Format(PyExc_ValueError,
+			 "unknown attribute value %200s", str);
+
+	    free(str);
+	    return -1;
+	}
+	free(str);
+    } else if (PyFunction_Check(value))
+	linebreak_set_urgent(lb, urgent_func, (void *) value);
+    else {
+	PyErr_Format(PyExc_ValueError,
+		     "attribute must be list, not %200s",
+		     Py_TYPE(value)->tp_name);
+	return -1;
+    }
+    return 0;
+}
+
+_set_Boolean(virama_as_joiner, LINEBREAK_OPTION_VIRAMA_AS_JOINER)
+
+static PyGetSetDef LineBreak_getseters[] = {
+    /* undocumented attributes */
+    {"linebreakType",
+     NULL,
      (setter) LineBreak_set_linebreakType,
      NULL},
     {"gcstrType",
@@ -1724,369 +3696,1305 @@ See also \":ref:`Tailoring Character Properties`\".")},
      (getter) LineBreak_get_format,
      (setter) LineBreak_set_format,
      PyDoc_STR("\
-Specify the method to format broken lines.\n\
+Specify the method to format broken lines.\n\
+\n\
+``\"SIMPLE\"``\n\
+    Just only insert newline at arbitrary breaking positions.\n\
+``\"NEWLINE\"``\n\
+    Insert or replace newline sequences with that specified by newline \n\
+    option, remove SPACEs leading newline sequences or end-of-text.  Then \n\
+    append newline at end of text if it does not exist.\n\
+``\"TRIM\"``\n\
+    Insert newline at arbitrary breaking positions.  Remove SPACEs \n\
+    leading newline sequences.\n\
+``\"FIXED\"``\n\
+    Same as ``\"NEWLINE\"`` except that paragraphs beginning with \">\" \n\
+    won't be folded and paragraphs are separated by empty line.\n\
+``\"FLOWED\"``\n\
+    \"Format=Flowed; DelSp=Yes\" formatting defined by :rfc:`3676`, \n\
+    with quotation marks of quoted paragraphs repeated on each line.\n\
+``None``\n\
+    Do nothing, even inserting any newlines.\n\
+callable object\n\
+    See \":ref:`Formatting Lines`\".")},
+    {"hangul_as_al",
+     (getter) LineBreak_get_hangul_as_al,
+     (setter) LineBreak_set_hangul_as_al,
+     PyDoc_STR("\
+Treat :term:`hangul` syllables and conjoining jamo as \
+:term:`alphabetic character`\\ s (AL).")},
+    {"lbc",
+     (getter) LineBreak_get_lbc,
+     (setter) LineBreak_set_lbc,
+     PyDoc_STR("\
+Tailor classification of line breaking property defined by [UAX14]_.  \
+Value may be a dictionary with its keys are Unicode string or \
+UCS scalar and its values with any of \
+:term:`line breaking classes<line breaking class>` (See Consts module).  \
+If ``None`` is specified, all tailoring assigned before will be canceled.\n\
+By default, no tailorings are available.\n\
+See also \":ref:`Tailoring Character Properties`\".")},
+    {"legacy_cm",
+     (getter) LineBreak_get_legacy_cm,
+     (setter) LineBreak_set_legacy_cm,
+     PyDoc_STR("\
+Treat combining characters lead by a SPACE as an isolated \
+combining character (ID).  As of Unicode 5.0, such use of SPACE is not \
+recommended.")},
+    {"newline",
+     (getter) LineBreak_get_newline,
+     (setter) LineBreak_set_newline,
+     PyDoc_STR("\
+Unicode string to be used for newline sequence.  \
+It may be ``None``.")},
+    {"prep",
+     (getter) LineBreak_get_prep,
+     (setter) LineBreak_set_prep,
+     PyDoc_STR("\
+Add user-defined line breaking behavior(s).  \
+Value shall be list of items described below.\n\
+\n\
+``\"NONBREAKURI\"``\n\
+    Won't break URIs.\n\
+``\"BREAKURI\"``\n\
+    Break URIs according to a rule suitable for printed materials.  For \n\
+    more details see [CMOS]_, sections 6.17 and 17.11.\n\
+(*regex*, *callable object*\\ [, *flags*])\n\
+    The sequences matching *regex* will be broken by *callable object*.  \n\
+    If *regex* is a string, not a regex object, *flags* may be specified. \n\
+    For more details see \":ref:`User-Defined Breaking Behaviors`\".\n\
+``None``\n\
+    Cancel all methods assigned before.")},
+    {"sizing",
+     (getter) LineBreak_get_sizing,
+     (setter) LineBreak_set_sizing,
+     PyDoc_STR("\
+Specify method to calculate size of string.  \
+Following options are available.\n\
+\n\
+``\"UAX11\"``\n\
+    Sizes are computed by columns of each characters.\n\
+``\"UAX11_TABS\"``\n\
+    Same as ``\"UAX11\"`` except that horizontal tabs advance to the next \n\
+    tab stop.  See :attr:`tabsize` attribute.\n\
+``None``\n\
+    Number of grapheme clusters (See documentation of GCStr class) \n\
+    contained in the string.\n\
+callable object\n\
+    See \":ref:`Calculating String Size`\".\n\
+\n\
+See also :attr:`eaw` attribute.")},
+    {"tabsize",
+     (getter) LineBreak_get_tabsize,
+     (setter) LineBreak_set_tabsize,
+     PyDoc_STR("\
+Interval of tab stops used by ``\"UAX11_TABS\"`` :attr:`sizing` \
+method: a horizontal tab classified to SP occupies columns up to the next \
+tab stop.  If it is 0, horizontal tabs occupy no columns.  Default is 8.  \
+Value is kept while other sizing method is used, and setting it won't \
+change :attr:`sizing`.")},
+    {"urgent",
+     (getter) LineBreak_get_urgent,
+     (setter) LineBreak_set_urgent,
+     PyDoc_STR("\
+Specify method to handle excessing lines.  \
+Following options are available.\n\
+\n\
+``\"RAISE\"``\n\
+    Raise a :exc:`LineBreakException` exception.\n\
+``\"FORCE\"``\n\
+    Force breaking excessing fragment.\n\
+``None``\n\
+    Won't break excessing fragment.\n\
+callable object\n\
+    See \":ref:`User-Defined Breaking Behaviors`\".")},
+    {"virama_as_joiner",
+     (getter) LineBreak_get_virama_as_joiner,
+     (setter) LineBreak_set_virama_as_joiner,
+     PyDoc_STR("\
+:term:`Virama sign` (\"halant\" in Hindi, \"coeng\" in Khmer) and its \n\
+succeeding letter are not broken.\n\
+\"Default\" grapheme cluster defined by [UAX29]_ does not contain this \
+feature.")},
+    {NULL}			/* Sentinel */
+};
+
+/*
+ * Mapping methods
+ */
+
+static int
+LineBreak_contains(PyObject *self, PyObject *value)
+{
+    return PySequence_Contains(STASH_DICT(LineBreak_AS_CSTRUCT(self)),
+			       value);
+}
+
+static PySequenceMethods LineBreak_as_sequence = {
+    0,				/* sq_length */
+    0,				/* sq_concat */
+    0,				/* sq_repeat */
+    0,				/* sq_item */
+    0,				/* sq_slice */
+    0,				/* sq_ass_item */
+    0,				/* sq_ass_slice */
+    LineBreak_contains,		/* sq_contains */
+    0,				/* sq_inplace_concat */
+    0,				/* sq_inplace_repeat */
+};
+
+static Py_ssize_t
+LineBreak_length(PyObject * self)
+{
+    return PyMapping_Length(STASH_DICT(LineBreak_AS_CSTRUCT(self)));
+}
+
+static PyObject *
+LineBreak_subscript(PyObject * self, PyObject * key)
+{
+    return PyObject_GetItem(STASH_DICT(LineBreak_AS_CSTRUCT(self)), key);
+}
+
+static int
+LineBreak_ass_subscript(PyObject * self, PyObject * key, PyObject * value)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+
+    if (LineBreak_CheckWritable(self) != 0)
+	return -1;
+    if (value == NULL)
+	return PyObject_DelItem(STASH_DICT(lb), key);
+    else
+	return PyObject_SetItem(STASH_DICT(lb), key, value);
+}
+
+static PyMappingMethods LineBreak_as_mapping = {
+    LineBreak_length,		/* mp_length */
+    LineBreak_subscript,	/* mp_subscript */
+    LineBreak_ass_subscript	/* mp_ass_subscript */
+};
+
+static PyObject *
+LineBreak_iter(PyObject *self)
+{
+    return PyObject_GetIter(STASH_DICT(LineBreak_AS_CSTRUCT(self)));
+}
+
+#define LineBreak_dictmethod_noargs(meth) \
+static PyObject * \
+LineBreak_##meth(PyObject *self) \
+{ \
+    PyObject *dict, *method, *ret; \
+    dict = STASH_DICT(LineBreak_AS_CSTRUCT(self)); \
+    if ((method = PyObject_GetAttrString(dict, #meth)) == NULL) \
+	return NULL; \
+    ret = PyObject_CallObject(method, NULL); \
+    Py_DECREF(method); \
+    return ret; \
+}
+#define LineBreak_dictmethod_varargs(meth) \
+static PyObject * \
+LineBreak_##meth(PyObject *self, PyObject *args) \
+{ \
+    PyObject *dict, *method, *ret; \
+    dict = STASH_DICT(LineBreak_AS_CSTRUCT(self)); \
+    if ((method = PyObject_GetAttrString(dict, #meth)) == NULL) \
+	return NULL; \
+    ret = PyObject_CallObject(method, args); \
+    Py_DECREF(method); \
+    return ret; \
+}
+#define LineBreak_dictmethod_keywords(meth) \
+static PyObject * \
+LineBreak_##meth(PyObject *self, PyObject *args, PyObject *kw) \
+{ \
+    PyObject *dict, *method, *ret; \
+    dict = STASH_DICT(LineBreak_AS_CSTRUCT(self)); \
+    if ((method = PyObject_GetAttrString(dict, #meth)) == NULL) \
+	return NULL; \
+    ret = PyObject_Call(method, args, kw); \
+    Py_DECREF(method); \
+    return ret; \
+}
+
+LineBreak_dictmethod_varargs(get)
+LineBreak_dictmethod_varargs(setdefault)
+LineBreak_dictmethod_varargs(pop)
+LineBreak_dictmethod_noargs(popitem)
+LineBreak_dictmethod_noargs(keys)
+LineBreak_dictmethod_noargs(items)
+LineBreak_dictmethod_noargs(values)
+LineBreak_dictmethod_keywords(update)
+LineBreak_dictmethod_noargs(clear)
+LineBreak_dictmethod_noargs(copy)
+
+/*
+ * Class-specific methods
+ */
+
+PyDoc_STRVAR(LineBreak_Copy__doc__, "\
+Copy LineBreak object.");
+
+static PyObject *
+LineBreak_Copy(PyObject * self, PyObject * args)
+{
+    LineBreakObject *obj = (LineBreakObject *) self;
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    PyObject *ret;
+
+    /* linebreak object is shared until either object is modified. */
+    if (obj->nshare == NULL) {
+	if ((obj->nshare = malloc(sizeof(size_t))) == NULL)
+	    return PyErr_NoMemory();
+	*obj->nshare = 1;
+    }
+    linebreak_incref(lb);
+    if ((ret = LineBreak_FromCstruct(Py_TYPE(self), lb)) == NULL) {
+	linebreak_destroy(lb);
+	return NULL;
+    }
+    ((LineBreakObject *) ret)->nshare = obj->nshare;
+    (*obj->nshare)++;
+    ((LineBreakObject *) ret)->tabsize = obj->tabsize;
+    return ret;
+}
+
+/*
+ * Breaking rules between pairs of line breaking classes resolved by
+ * linebreak_get_lbrule() for each combination of options, so that a rule
+ * is got by one table lookup without checking options.  Tables are made at
+ * first use and kept until the end of process.
+ * @note Used only by breakingRule() and unfold().  Line breaking itself
+ * looks rules up inside sombok.
+ */
+typedef struct _lbrules_t {
+    unsigned int options;
+    struct _lbrules_t *next;
+    propval_t rule[1];		/* lbrules_nclasses ** 2 entries */
+} lbrules_t;
+
+static lbrules_t *lbrules_cache = NULL;
+static size_t lbrules_nclasses = 0;
+
+/*
+ * Get table of breaking rules for options of linebreak object lb.
+ * If error occurred, NULL will be returned.
+ * @note GIL must be held.
+ */
+static lbrules_t *
+lbrules_get(linebreak_t * lb)
+{
+    lbrules_t *rules;
+    size_t b, a;
+
+    for (rules = lbrules_cache; rules != NULL; rules = rules->next)
+	if (rules->options == lb->options)
+	    return rules;
+
+    if (lbrules_nclasses == 0)
+	while (linebreak_propvals_LB[lbrules_nclasses] != NULL)
+	    lbrules_nclasses++;
+    if ((rules = malloc(sizeof(lbrules_t) + sizeof(propval_t) *
+			lbrules_nclasses * lbrules_nclasses)) == NULL)
+	return NULL;
+    rules->options = lb->options;
+    for (b = 0; b < lbrules_nclasses; b++)
+	for (a = 0; a < lbrules_nclasses; a++)
+	    rules->rule[b * lbrules_nclasses + a] =
+		linebreak_get_lbrule(lb, (propval_t) b, (propval_t) a);
+    rules->next = lbrules_cache;
+    lbrules_cache = rules;
+    return rules;
+}
+
+/*
+ * Get breaking rule between classes blbc and albc by table of rules for
+ * linebreak object lb.
+ * @note GIL must be held.
+ */
+static propval_t
+lbrules_rule(linebreak_t * lb, propval_t blbc, propval_t albc)
+{
+    lbrules_t *rules;
+
+    if ((rules = lbrules_get(lb)) != NULL &&
+	blbc < lbrules_nclasses && albc < lbrules_nclasses)
+	return rules->rule[blbc * lbrules_nclasses + albc];
+    return linebreak_get_lbrule(lb, blbc, albc);
+}
+
+PyDoc_STRVAR(LineBreak_breakingRule__doc__, "\
+S.rule(before, after) -> int\n\
+\n\
+Get possible line breaking behavior between strings *before* and *after*.\n\
+Returned value is one of:\n\
+\n\
+``MANDATORY``\n\
+    :term:`Mandatory break`.\n\
+``DIRECT``\n\
+    Both :term:`direct break` and :term:`indirect break` are allowed.\n\
+``INDIRECT``\n\
+    Indirect break is allowed but direct break is prohibited.\n\
+``PROHIBITED``\n\
+    Breaking is prohibited.\n\
+\n\
+Following instance attributes of LineBreak object S will affect to result.\n\
+\n\
+- :attr:`eastasian_context`\n\
+- :attr:`hangul_as_al`\n\
+- :attr:`lbc`\n\
+- :attr:`legacy_cm`\n\
+\n\
+.. note::\n\
+   This method gives just approximate description of line breaking\n\
+   behavior.  Use :meth:`wrap<LineBreak.wrap>` method or \n\
+   :ref:`other functions<Functions>` to fold actual texts.");
+
+static PyObject *
+LineBreak_breakingRule(PyObject * self, PyObject * args)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    PyObject *before, *after;
+    gcstring_t *bgcstr, *agcstr;
+    propval_t blbc, albc, ret;
+
+    if (!PyArg_ParseTuple(args, "OO", &before, &after))
+        return NULL;
+    if ((bgcstr = genericstr_ToCstruct(before, lb)) == NULL)
+	return NULL;
+    if (bgcstr->gclen == 0) {
+	if (! GCStr_Check(before))
+	    gcstring_destroy(bgcstr);
+	Py_RETURN_NONE;
+    }
+    if ((agcstr = genericstr_ToCstruct(after, lb)) == NULL) {
+	if (! GCStr_Check(before))
+	    gcstring_destroy(bgcstr);
+	return NULL;
+    }
+    if (agcstr->gclen == 0) {
+	if (! GCStr_Check(before))
+	    gcstring_destroy(bgcstr);
+	if (! GCStr_Check(after))
+	    gcstring_destroy(agcstr);
+	Py_RETURN_NONE;
+    }
+
+    blbc = gcstring_lbclass_ext(bgcstr, -1);
+    albc = gcstring_lbclass(agcstr, 0);
+    ret = lbrules_rule(lb, blbc, albc);
+
+    if (! GCStr_Check(before))
+	gcstring_destroy(bgcstr);
+    if (! GCStr_Check(after))
+	gcstring_destroy(agcstr);
+
+    if (ret == PROP_UNKNOWN) {
+	Py_RETURN_NONE;
+    }
+    return PyInt_FromLong((long)ret);
+}
+
+/*
+ * Convert result of breaking str to list of GCStr objects.  Type of items
+ * will be the same as str if it is GCStr object.  Result will be freed.
+ * If error occurred, exception will be raised and NULL will be returned.
+ */
+static PyObject *
+break_result_ToList(linebreak_t * lb, PyObject * str, gcstring_t ** broken)
+{
+    PyTypeObject *gcstr_type;
+    PyObject *ret, *v;
+    size_t i, len;
+
+    if (GCStr_Check(str))
+	gcstr_type = Py_TYPE(str);
+    else
+	gcstr_type = STASH_GCSTRTYPE(lb);
+
+    for (len = 0; broken[len] != NULL; len++)
+	;
+    if ((ret = PyList_New(len)) == NULL) {
+	linebreak_free_result(broken, 1);
+	return NULL;
+    }
+    for (i = 0; i < len; i++) {
+	if ((v = GCStr_FromCstruct(gcstr_type, broken[i])) == NULL) {
+	    Py_DECREF(ret);
+	    for ( ; broken[i] != NULL; i++)
+		gcstring_destroy(broken[i]);
+	    linebreak_free_result(broken, 0);
+	    return NULL;
+	}
+	PyList_SET_ITEM(ret, i, v);
+    }
+    linebreak_free_result(broken, 0);
+    return ret;
+}
+
+/*
+ * Get number of threads by parallel argument.  True means number of CPUs.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+parallel_ToThreads(PyObject * parallel)
+{
+    static int ncpus = 0;
+    PyObject *module, *ret;
+    long n;
+    int istrue;
+
+    if (parallel == NULL)
+	return 1;
+    if ((istrue = PyObject_IsTrue(parallel)) <= 0)
+	return istrue ? -1 : 1;
+
+    if (parallel != Py_True) {
+	if ((n = PyInt_AsLong(parallel)) == -1 && PyErr_Occurred())
+	    return -1;
+	if (n < 1) {
+	    PyErr_SetString(PyExc_ValueError, "parallel must be positive");
+	    return -1;
+	}
+	return (INT_MAX < n) ? INT_MAX : (int) n;
+    }
+
+    if (ncpus == 0) {
+	ncpus = 1;
+	if ((module = PyImport_ImportModule("multiprocessing")) != NULL) {
+	    ret = PyObject_CallMethod(module, "cpu_count", NULL);
+	    if (ret != NULL && 1 < (n = PyInt_AsLong(ret)))
+		ncpus = (INT_MAX < n) ? INT_MAX : (int) n;
+	    Py_XDECREF(ret);
+	    Py_DECREF(module);
+	}
+	/* Number of CPUs is unknown: break serially. */
+	PyErr_Clear();
+    }
+    return ncpus;
+}
+
+/*
+ * Get linebreak object to break text for LineBreak object self.  If self
+ * is frozen, an idle private copy is taken or new one is made, so that
+ * frozen object may be used by several threads at once.  Otherwise,
+ * linebreak object shared with copies is used only if breaking by it never
+ * calls Python.
+ * It must be released by LineBreak_ReleaseCstruct().
+ * If error occurred, exception will be raised and NULL will be returned.
+ */
+static linebreak_t *
+LineBreak_AcquireCstruct(PyObject * self)
+{
+    FrozenLineBreakObject *frozen = (FrozenLineBreakObject *) self;
+    linebreak_t *lb;
+
+    if (!FrozenLineBreak_Check(self)) {
+	/* Python callbacks might break by copies sharing linebreak object. */
+	if (!linebreak_is_builtin(LineBreak_AS_CSTRUCT(self)) &&
+	    LineBreak_Unshare(self) != 0)
+	    return NULL;
+	return LineBreak_AS_CSTRUCT(self);
+    }
+    if (frozen->nidle)
+	return frozen->idle[--frozen->nidle];
+    if ((lb = break_copy(LineBreak_AS_CSTRUCT(self))) == NULL)
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+    return lb;
+}
+
+/*
+ * Release linebreak object got by LineBreak_AcquireCstruct().  Private
+ * copy is kept idle unless its state might be broken by errors.
+ */
+static void
+LineBreak_ReleaseCstruct(PyObject * self, linebreak_t * lb)
+{
+    FrozenLineBreakObject *frozen = (FrozenLineBreakObject *) self;
+    int reuse;
+
+    if (!FrozenLineBreak_Check(self))
+	return;
+    reuse = (lb->errnum == 0 && frozen->nidle < FROZEN_IDLE_MAX &&
+	     lb->colmax == LineBreak_AS_CSTRUCT(self)->colmax);
+    if (reuse) {
+	linebreak_reset(lb);
+	frozen->idle[frozen->nidle++] = lb;
+    } else
+	linebreak_destroy(lb);
+}
+
+PyDoc_STRVAR(LineBreak_wrap__doc__, "\
+S.wrap(text[, parallel=False]) -> [GCStr]\n\
 \n\
-``\"SIMPLE\"``\n\
-    Just only insert newline at arbitrary breaking positions.\n\
-``\"NEWLINE\"``\n\
-    Insert or replace newline sequences with that specified by newline \n\
-    option, remove SPACEs leading newline sequences or end-of-text.  Then \n\
-    append newline at end of text if it does not exist.\n\
-``\"TRIM\"``\n\
-    Insert newline at arbitrary breaking positions.  Remove SPACEs \n\
-    leading newline sequences.\n\
-``None``\n\
-    Do nothing, even inserting any newlines.\n\
-callable object\n\
-    See \":ref:`Formatting Lines`\".")},
-    {"hangul_as_al",
-     (getter) LineBreak_get_hangul_as_al,
-     (setter) LineBreak_set_hangul_as_al,
-     PyDoc_STR("\
-Treat :term:`hangul` syllables and conjoining jamo as \
-:term:`alphabetic character`\\ s (AL).")},
-    {"lbc",
-     (getter) LineBreak_get_lbc,
-     (setter) LineBreak_set_lbc,
-     PyDoc_STR("\
-Tailor classification of line breaking property defined by [UAX14]_.  \
-Value may be a dictionary with its keys are Unicode string or \
-UCS scalar and its values with any of \
-:term:`line breaking classes<line breaking class>` (See Consts module).  \
-If ``None`` is specified, all tailoring assigned before will be canceled.\n\
-By default, no tailorings are available.\n\
-See also \":ref:`Tailoring Character Properties`\".")},
-    {"legacy_cm",
-     (getter) LineBreak_get_legacy_cm,
-     (setter) LineBreak_set_legacy_cm,
-     PyDoc_STR("\
-Treat combining characters lead by a SPACE as an isolated \
-combining character (ID).  As of Unicode 5.0, such use of SPACE is not \
-recommended.")},
-    {"newline",
-     (getter) LineBreak_get_newline,
-     (setter) LineBreak_set_newline,
-     PyDoc_STR("\
-Unicode string to be used for newline sequence.  \
-It may be ``None``.")},
-    {"prep",
-     (getter) LineBreak_get_prep,
-     (setter) LineBreak_set_prep,
-     PyDoc_STR("\
-Add user-defined line breaking behavior(s).  \
-Value shall be list of items described below.\n\
+Break a Unicode string *text* and returns list of lines contained in the\n\
+result.  Each item of list is grapheme cluster string (:class:`GCStr`\n\
+object).\n\
 \n\
-``\"NONBREAKURI\"``\n\
-    Won't break URIs.\n\
-``\"BREAKURI\"``\n\
-    Break URIs according to a rule suitable for printed materials.  For \n\
-    more details see [CMOS]_, sections 6.17 and 17.11.\n\
-(*regex*, *callable object*\\ [, *flags*])\n\
-    The sequences matching *regex* will be broken by *callable object*.  \n\
-    If *regex* is a string, not a regex object, *flags* may be specified. \n\
-    For more details see \":ref:`User-Defined Breaking Behaviors`\".\n\
-``None``\n\
-    Cancel all methods assigned before.")},
-    {"sizing",
-     (getter) LineBreak_get_sizing,
-     (setter) LineBreak_set_sizing,
-     PyDoc_STR("\
-Specify method to calculate size of string.  \
-Following options are available.\n\
+If *parallel* is true, long text is divided into paragraphs, i.e. at\n\
+mandatory breaks, and they are broken by native threads as many as CPUs,\n\
+or as *parallel* if it is a number.  Result is the same as serial\n\
+breaking.  If any Python callbacks are used, text is broken serially.");
+
+static PyObject *
+LineBreak_wrap(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    static char *keywords[] = { "text", "parallel", NULL };
+    PyObject *str, *parallel = NULL;
+    breakinput_t in;
+    gcstring_t **broken;
+    linebreak_t *lbobj;
+    int nthreads;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", keywords,
+				     &str, &parallel))
+	return NULL;
+    if ((nthreads = parallel_ToThreads(parallel)) < 0)
+	return NULL;
+
+    if (1 < nthreads && linebreak_is_builtin(lb)) {
+	if (breakinput_init(&in, str) != 0)
+	    return NULL;
+	/* Text given by feed() is discarded. */
+	if (!FrozenLineBreak_Check(self))
+	    linebreak_reset(lb);
+	broken = do_break_parallel(lb, &in, 0, in.len, nthreads);
+	breakinput_release(&in);
+    } else {
+	if ((lbobj = LineBreak_AcquireCstruct(self)) == NULL)
+	    return NULL;
+	broken = do_break_unicode(lbobj, self, str);
+	LineBreak_ReleaseCstruct(self, lbobj);
+    }
+    if (broken == NULL)
+	return NULL;
+    return break_result_ToList(lb, str, broken);
+}
+
+static PyObject *LineBreakIter_New(PyObject *, PyObject *);
+
+PyDoc_STRVAR(LineBreak_iwrap__doc__, "\
+S.iwrap(text) -> iterator\n\
 \n\
-``\"UAX11\"``\n\
-    Sizes are computed by columns of each characters.\n\
-``None``\n\
-    Number of grapheme clusters (See documentation of GCStr class) \n\
-    contained in the string.\n\
-callable object\n\
-    See \":ref:`Calculating String Size`\".\n\
+Break a Unicode string *text* and returns an iterator yielding lines\n\
+contained in the result one by one.  Lines are the same as :meth:`wrap`\n\
+returns, but text is broken gradually as the iterator advances.\n\
 \n\
-See also :attr:`eaw` attribute.")},
-    {"urgent",
-     (getter) LineBreak_get_urgent,
-     (setter) LineBreak_set_urgent,
-     PyDoc_STR("\
-Specify method to handle excessing lines.  \
-Following options are available.\n\
+Text is broken by a copy of this object taken by iwrap().  Changes made\n\
+to this object afterward, even by callbacks called while the iterator\n\
+advances, don't affect lines the iterator yields.");
+
+static PyObject *
+LineBreak_iwrap(PyObject * self, PyObject * args)
+{
+    PyObject *str;
+
+    if (!PyArg_ParseTuple(args, "O", &str))
+	return NULL;
+    return LineBreakIter_New(self, str);
+}
+
+PyDoc_STRVAR(LineBreak_wrap_many__doc__, "\
+S.wrap_many(texts[, threads=1]) -> [[GCStr]]\n\
 \n\
-``\"RAISE\"``\n\
-    Raise a :exc:`LineBreakException` exception.\n\
-``\"FORCE\"``\n\
-    Force breaking excessing fragment.\n\
-``None``\n\
-    Won't break excessing fragment.\n\
-callable object\n\
-    See \":ref:`User-Defined Breaking Behaviors`\".")},
-    {"virama_as_joiner",
-     (getter) LineBreak_get_virama_as_joiner,
-     (setter) LineBreak_set_virama_as_joiner,
-     PyDoc_STR("\
-:term:`Virama sign` (\"halant\" in Hindi, \"coeng\" in Khmer) and its \n\
-succeeding letter are not broken.\n\
-\"Default\" grapheme cluster defined by [UAX29]_ does not contain this \
-feature.")},
-    {NULL}			/* Sentinel */
-};
+Break each of Unicode strings *texts* and returns list of results in the\n\
+same order, each of which is the same as :meth:`wrap` returns.  If no\n\
+Python callbacks are used, texts are broken by up to *threads* native\n\
+threads in parallel; otherwise they are broken in turn.");
+
+static PyObject *
+LineBreak_wrap_many(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    static char *keywords[] = { "texts", "threads", NULL };
+    PyObject *texts, *seq, *str, *ret, *v;
+    int nthreads = 1;
+    breakinput_t *inputs;
+    breakjob_t *jobs;
+    gcstring_t **broken;
+    linebreak_t *lbobj;
+    size_t i, njobs;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", keywords,
+				     &texts, &nthreads))
+	return NULL;
+    if (nthreads < 1) {
+	PyErr_SetString(PyExc_ValueError, "threads must be positive");
+	return NULL;
+    }
+    if ((seq = PySequence_Fast(texts, "texts must be iterable")) == NULL)
+	return NULL;
+    njobs = PySequence_Fast_GET_SIZE(seq);
+    if ((ret = PyList_New(njobs)) == NULL) {
+	Py_DECREF(seq);
+	return NULL;
+    }
+
+    if (!linebreak_is_builtin(lb)) {
+	if ((lbobj = LineBreak_AcquireCstruct(self)) == NULL) {
+	    Py_DECREF(ret);
+	    Py_DECREF(seq);
+	    return NULL;
+	}
+	for (i = 0; i < njobs; i++) {
+	    str = PySequence_Fast_GET_ITEM(seq, i);
+	    if ((broken = do_break_unicode(lbobj, self, str)) == NULL ||
+		(v = break_result_ToList(lb, str, broken)) == NULL) {
+		LineBreak_ReleaseCstruct(self, lbobj);
+		Py_DECREF(ret);
+		Py_DECREF(seq);
+		return NULL;
+	    }
+	    PyList_SET_ITEM(ret, i, v);
+	}
+	LineBreak_ReleaseCstruct(self, lbobj);
+	Py_DECREF(seq);
+	return ret;
+    }
+
+    inputs = PyMem_Malloc(sizeof(breakinput_t) * (njobs + 1));
+    jobs = PyMem_Malloc(sizeof(breakjob_t) * (njobs + 1));
+    if (inputs == NULL || jobs == NULL) {
+	PyMem_Free(inputs);
+	PyMem_Free(jobs);
+	Py_DECREF(ret);
+	Py_DECREF(seq);
+	return PyErr_NoMemory();
+    }
+    for (i = 0; i < njobs; i++) {
+	if (breakinput_init(inputs + i,
+			    PySequence_Fast_GET_ITEM(seq, i)) != 0) {
+	    while (0 < i--)
+		breakinput_release(inputs + i);
+	    PyMem_Free(inputs);
+	    PyMem_Free(jobs);
+	    Py_DECREF(ret);
+	    Py_DECREF(seq);
+	    return NULL;
+	}
+	jobs[i].in = inputs + i;
+	jobs[i].pos = 0;
+	jobs[i].len = inputs[i].len;
+    }
+
+    if (do_break_many(lb, jobs, njobs, nthreads) != 0) {
+	for (i = 0; i < njobs; i++)
+	    breakinput_release(inputs + i);
+	PyMem_Free(inputs);
+	PyMem_Free(jobs);
+	Py_DECREF(ret);
+	Py_DECREF(seq);
+	return NULL;
+    }
+
+    for (i = 0; i < njobs; i++) {
+	breakinput_release(inputs + i);
+	if (ret == NULL) {
+	    if (jobs[i].broken != NULL)
+		linebreak_free_result(jobs[i].broken, 1);
+	} else if (jobs[i].broken == NULL) {
+	    break_seterror(lb, jobs[i].errnum);
+	    Py_CLEAR(ret);
+	} else if ((v = break_result_ToList(lb,
+					    PySequence_Fast_GET_ITEM(seq, i),
+					    jobs[i].broken)) == NULL)
+	    Py_CLEAR(ret);
+	else
+	    PyList_SET_ITEM(ret, i, v);
+    }
+    PyMem_Free(inputs);
+    PyMem_Free(jobs);
+    Py_DECREF(seq);
+    return ret;
+}
+
+PyDoc_STRVAR(LineBreak_feed__doc__, "\
+S.feed(text) -> [GCStr]\n\
+\n\
+Break a Unicode string *text* as a part of longer text following the\n\
+parts given by previous calls, and returns list of lines which have been\n\
+determined.  The rest will be returned by later calls of :meth:`feed` or\n\
+by :meth:`flush`.  Text not yet returned is kept by LineBreak object S\n\
+and may be discarded by calling :meth:`wrap` before :meth:`flush`.");
+
+static PyObject *
+LineBreak_feed(PyObject * self, PyObject * args)
+{
+    linebreak_t *lb;
+    PyObject *str;
+    breakinput_t in;
+    gcstring_t **broken;
+
+    if (!PyArg_ParseTuple(args, "O", &str))
+	return NULL;
+    if (LineBreak_Unshare(self) != 0)
+	return NULL;
+    lb = LineBreak_AS_CSTRUCT(self);
+    if (breakinput_init(&in, str) != 0)
+	return NULL;
+    broken = do_break_partial(lb, self, &in, 0, in.len);
+    breakinput_release(&in);
+    if (broken == NULL)
+	return NULL;
+    return break_result_ToList(lb, str, broken);
+}
+
+PyDoc_STRVAR(LineBreak_flush__doc__, "\
+S.flush() -> [GCStr]\n\
+\n\
+Break the rest of text given by :meth:`feed` and returns list of lines.\n\
+After that, S may be used for new text.");
+
+static PyObject *
+LineBreak_flush(PyObject * self, PyObject * args)
+{
+    linebreak_t *lb;
+    gcstring_t **broken;
+
+    if (LineBreak_Unshare(self) != 0)
+	return NULL;
+    lb = LineBreak_AS_CSTRUCT(self);
+    if ((broken = do_break_partial(lb, self, NULL, 0, 0)) == NULL)
+	return NULL;
+    return break_result_ToList(lb, Py_None, broken);
+}
+
+#if PY_MAJOR_VERSION >= 4 || (PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION >= 3)
+#   define BREAKPOINTS_TYPECODE "q"
+typedef PY_LONG_LONG breakpoint_t;
+#else				/* PY_MAJOR_VERSION ... */
+#   define BREAKPOINTS_TYPECODE "l"
+typedef long breakpoint_t;
+#endif				/* PY_MAJOR_VERSION ... */
+
+PyDoc_STRVAR(LineBreak_breakpoints__doc__, "\
+S.breakpoints(text) -> array\n\
+\n\
+Break a Unicode string *text* and returns offsets into *text* of the end\n\
+of each line, in code points, as an :mod:`array` of integers.  Lines are\n\
+broken without *format*, so that offsets are not shifted by inserted\n\
+newlines; other options and callbacks are used as :meth:`wrap` does.  If\n\
+*prep* or *urgent* callbacks modify text, ValueError is raised.\n\
+No :class:`GCStr` objects are created.");
+
+static PyObject *
+LineBreak_breakpoints(PyObject * self, PyObject * args)
+{
+    linebreak_t *lb;
+    PyObject *str, *module, *buf, *ret;
+    gcstring_t *(*format_func) (linebreak_t *, linebreak_state_t,
+				gcstring_t *);
+    void *format_data;
+    breakinput_t in;
+    breakpoint_t *offsets;
+    gcstring_t **broken;
+    size_t i, j, len, off;
+
+    if (!PyArg_ParseTuple(args, "O", &str))
+	return NULL;
+    if ((module = PyImport_ImportModule("array")) == NULL)
+	return NULL;
+    if (breakinput_init(&in, str) != 0) {
+	Py_DECREF(module);
+	return NULL;
+    }
+    /* Format is dropped for a while: copies must not see it. */
+    if ((!FrozenLineBreak_Check(self) && LineBreak_Unshare(self) != 0) ||
+	(lb = LineBreak_AcquireCstruct(self)) == NULL) {
+	breakinput_release(&in);
+	Py_DECREF(module);
+	return NULL;
+    }
+    format_func = lb->format_func;
+    format_data = lb->format_data;
+    lb->format_func = NULL;
+    broken = do_break_input(lb, self, &in, 0, in.len);
+    /* Format may have been replaced by callbacks. */
+    if (lb->format_func == NULL && lb->format_data == format_data)
+	lb->format_func = format_func;
+    LineBreak_ReleaseCstruct(self, lb);
+    if (broken == NULL) {
+	breakinput_release(&in);
+	Py_DECREF(module);
+	return NULL;
+    }
+
+    for (len = 0; broken[len] != NULL; len++)
+	;
+    buf = PyBytes_FromStringAndSize(NULL, sizeof(breakpoint_t) * len);
+    if (buf == NULL) {
+	breakinput_release(&in);
+	Py_DECREF(module);
+	linebreak_free_result(broken, 1);
+	return NULL;
+    }
+    offsets = (breakpoint_t *) PyBytes_AS_STRING(buf);
+    for (i = 0, off = 0; i < len; i++) {
+	for (j = 0; j < broken[i]->len; j++, off++)
+	    if (in.len <= off ||
+		broken[i]->str[j] != breakinput_char(&in, off))
+		break;
+	if (j < broken[i]->len)
+	    break;
+	offsets[i] = (breakpoint_t) off;
+    }
+    linebreak_free_result(broken, 1);
+    if (i < len || off != in.len) {
+	breakinput_release(&in);
+	Py_DECREF(buf);
+	Py_DECREF(module);
+	PyErr_SetString(PyExc_ValueError, "text was modified by callbacks");
+	return NULL;
+    }
+    breakinput_release(&in);
+
+    ret = PyObject_CallMethod(module, "array", "sO", BREAKPOINTS_TYPECODE,
+			      buf);
+    Py_DECREF(buf);
+    Py_DECREF(module);
+    return ret;
+}
 
 /*
- * Mapping methods
+ * Append len characters of s to buf of which siz characters are allocated,
+ * extending it.
+ * If error occurred, exception will be raised and -1 will be returned.
  */
-
 static int
-LineBreak_contains(PyObject *self, PyObject *value)
+unistr_append(unistr_t * buf, size_t * siz, unichar_t * s, size_t len)
 {
-    return PySequence_Contains(STASH_DICT(LineBreak_AS_CSTRUCT(self)),
-			       value);
+    unichar_t *p;
+    size_t newsiz;
+
+    if (len == 0)
+	return 0;
+    if (*siz < buf->len + len) {
+	for (newsiz = (*siz) ? *siz : 64; newsiz < buf->len + len;
+	     newsiz *= 2);
+	if ((p = realloc(buf->str, sizeof(unichar_t) * newsiz)) == NULL) {
+	    PyErr_SetFromErrno(PyExc_RuntimeError);
+	    return -1;
+	}
+	buf->str = p;
+	*siz = newsiz;
+    }
+    memcpy(buf->str + buf->len, s, sizeof(unichar_t) * len);
+    buf->len += len;
+    return 0;
 }
 
-static PySequenceMethods LineBreak_as_sequence = {
-    0,				/* sq_length */
-    0,				/* sq_concat */
-    0,				/* sq_repeat */
-    0,				/* sq_item */
-    0,				/* sq_slice */
-    0,				/* sq_ass_item */
-    0,				/* sq_ass_slice */
-    LineBreak_contains,		/* sq_contains */
-    0,				/* sq_inplace_concat */
-    0,				/* sq_inplace_repeat */
-};
+/*
+ * Get line breaking rule between last grapheme cluster of bstr and first
+ * one of astr, the same as breakingRule() method.  Only several characters
+ * around the boundary are segmented unless a cluster may exceed them.
+ * If error occurred, exception will be raised and PROP_UNKNOWN will be
+ * returned.
+ */
+#define UNFOLD_WINDOW (16)
 
-static Py_ssize_t
-LineBreak_length(PyObject * self)
+static propval_t
+unfold_lbrule(linebreak_t * lb, unistr_t * bstr, unistr_t * astr)
 {
-    return PyMapping_Length(STASH_DICT(LineBreak_AS_CSTRUCT(self)));
+    unistr_t unistr;
+    gcstring_t *bgcstr, *agcstr;
+    propval_t blbc, albc;
+
+    unistr.str = bstr->str;
+    unistr.len = bstr->len;
+    if (UNFOLD_WINDOW < unistr.len) {
+	unistr.str += unistr.len - UNFOLD_WINDOW;
+	unistr.len = UNFOLD_WINDOW;
+    }
+    if ((bgcstr = gcstring_newcopy(&unistr, lb)) == NULL) {
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+	return PROP_UNKNOWN;
+    }
+    if (bgcstr->gclen == 1 && unistr.len < bstr->len) {
+	gcstring_destroy(bgcstr);
+	if ((bgcstr = gcstring_newcopy(bstr, lb)) == NULL) {
+	    PyErr_SetFromErrno(PyExc_RuntimeError);
+	    return PROP_UNKNOWN;
+	}
+    }
+
+    unistr.str = astr->str;
+    unistr.len = (UNFOLD_WINDOW < astr->len) ? UNFOLD_WINDOW : astr->len;
+    if ((agcstr = gcstring_newcopy(&unistr, lb)) == NULL) {
+	gcstring_destroy(bgcstr);
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+	return PROP_UNKNOWN;
+    }
+    if (agcstr->gclen == 1 && unistr.len < astr->len) {
+	gcstring_destroy(agcstr);
+	if ((agcstr = gcstring_newcopy(astr, lb)) == NULL) {
+	    gcstring_destroy(bgcstr);
+	    PyErr_SetFromErrno(PyExc_RuntimeError);
+	    return PROP_UNKNOWN;
+	}
+    }
+
+    if (bgcstr->gclen == 0 || agcstr->gclen == 0) {
+	gcstring_destroy(bgcstr);
+	gcstring_destroy(agcstr);
+	return PROP_UNKNOWN;
+    }
+    blbc = gcstring_lbclass_ext(bgcstr, -1);
+    albc = gcstring_lbclass(agcstr, 0);
+    gcstring_destroy(bgcstr);
+    gcstring_destroy(agcstr);
+    return lbrules_rule(lb, blbc, albc);
 }
 
-static PyObject *
-LineBreak_subscript(PyObject * self, PyObject * key)
+/*
+ * Find the end of line, i.e. position of LF or end of string.
+ */
+static size_t
+unfold_eol(unichar_t * s, size_t pos, size_t len)
 {
-    return PyObject_GetItem(STASH_DICT(LineBreak_AS_CSTRUCT(self)), key);
+    for (; pos < len && s[pos] != 0x000A; pos++);
+    return pos;
 }
 
+/*
+ * Unfold segment s of "fixed" text: Lines preceded by ">" won't be
+ * conjuncted and empty line is treated as paragraph separator.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
 static int
-LineBreak_ass_subscript(PyObject * self, PyObject * key, PyObject * value)
+unfold_fixed(linebreak_t * lb, unistr_t * buf, size_t * siz,
+	     unichar_t * s, size_t len, unistr_t * newline)
 {
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    unistr_t bstr, astr;
+    unichar_t space = 0x0020;
+    size_t pos, eol, end;
+    propval_t rule;
+
+    for (pos = 0; pos < len; pos = eol + 1) {
+	if (s[pos] == 0x000A) {
+	    if (unistr_append(buf, siz, newline->str, newline->len) != 0)
+		return -1;
+	    eol = pos;
+	    continue;
+	}
+	eol = unfold_eol(s, pos, len);
+
+	/*
+	 * Lines kept as they are: the last line, the line followed by empty
+	 * line (which is absorbed), the line preceded by ">" and the line
+	 * followed by the line preceded by ">".
+	 */
+	if (eol == len || eol + 1 == len || s[eol + 1] == 0x000A ||
+	    s[pos] == 0x003E || s[eol + 1] == 0x003E) {
+	    if (unistr_append(buf, siz, s + pos, eol - pos) != 0 ||
+		unistr_append(buf, siz, newline->str, newline->len) != 0)
+		return -1;
+	    if (eol + 1 < len && s[eol + 1] == 0x000A)
+		eol++;
+	    continue;
+	}
 
-    if (value == NULL)
-	return PyObject_DelItem(STASH_DICT(lb), key);
-    else
-	return PyObject_SetItem(STASH_DICT(lb), key, value);
+	/* Conjunct line with the next one. */
+	for (end = eol; pos + 1 < end && s[end - 1] == 0x0020; end--);
+	if (unistr_append(buf, siz, s + pos, end - pos) != 0)
+	    return -1;
+	if (s[eol + 1] == 0x0020) {
+	    if (unistr_append(buf, siz, newline->str, newline->len) != 0)
+		return -1;
+	} else if (end < eol) {
+	    if (unistr_append(buf, siz, s + end, eol - end) != 0)
+		return -1;
+	} else {
+	    bstr.str = s + pos;
+	    bstr.len = end - pos;
+	    astr.str = s + eol + 1;
+	    astr.len = unfold_eol(s, eol + 1, len) - (eol + 1);
+	    rule = unfold_lbrule(lb, &bstr, &astr);
+	    if (rule == PROP_UNKNOWN && PyErr_Occurred())
+		return -1;
+	    if (rule == LINEBREAK_ACTION_INDIRECT &&
+		unistr_append(buf, siz, &space, 1) != 0)
+		return -1;
+	}
+    }
+    return 0;
 }
 
-static PyMappingMethods LineBreak_as_mapping = {
-    LineBreak_length,		/* mp_length */
-    LineBreak_subscript,	/* mp_subscript */
-    LineBreak_ass_subscript	/* mp_ass_subscript */
-};
-
-static PyObject *
-LineBreak_iter(PyObject *self)
+/*
+ * Unfold segment s of "Format=Flowed" text defined by RFC 3676.  If delsp
+ * is true, trailing SPACEs of flowed lines are deleted (DelSp=Yes).
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+unfold_flowed(unistr_t * buf, size_t * siz, unichar_t * s, size_t len,
+	      unistr_t * newline, int delsp)
 {
-    return PyObject_GetIter(STASH_DICT(LineBreak_AS_CSTRUCT(self)));
-}
+    unichar_t space = 0x0020;
+    size_t pos, eol, start, end, nquote, prefix = 0;
+    int flowed = 0;		/* previous line is flowed one */
+
+    for (pos = 0; pos < len; pos = eol + 1) {
+	eol = unfold_eol(s, pos, len);
+	for (nquote = 0; pos + nquote < eol && s[pos + nquote] == 0x003E;
+	     nquote++);
+	start = pos + nquote;
+
+	/* The last line without newline. */
+	if (eol == len) {
+	    start = (s[pos] == 0x0020) ? pos + 1 : pos;
+	    if (unistr_append(buf, siz, s + start, len - start) != 0 ||
+		unistr_append(buf, siz, newline->str, newline->len) != 0)
+		return -1;
+	    break;
+	}
 
-#define LineBreak_dictmethod_noargs(meth) \
-static PyObject * \
-LineBreak_##meth(PyObject *self) \
-{ \
-    PyObject *dict, *method, *ret; \
-    dict = STASH_DICT(LineBreak_AS_CSTRUCT(self)); \
-    if ((method = PyObject_GetAttrString(dict, #meth)) == NULL) \
-	return NULL; \
-    ret = PyObject_CallObject(method, NULL); \
-    Py_DECREF(method); \
-    return ret; \
-}
-#define LineBreak_dictmethod_varargs(meth) \
-static PyObject * \
-LineBreak_##meth(PyObject *self, PyObject *args) \
-{ \
-    PyObject *dict, *method, *ret; \
-    dict = STASH_DICT(LineBreak_AS_CSTRUCT(self)); \
-    if ((method = PyObject_GetAttrString(dict, #meth)) == NULL) \
-	return NULL; \
-    ret = PyObject_CallObject(method, args); \
-    Py_DECREF(method); \
-    return ret; \
-}
-#define LineBreak_dictmethod_keywords(meth) \
-static PyObject * \
-LineBreak_##meth(PyObject *self, PyObject *args, PyObject *kw) \
-{ \
-    PyObject *dict, *method, *ret; \
-    dict = STASH_DICT(LineBreak_AS_CSTRUCT(self)); \
-    if ((method = PyObject_GetAttrString(dict, #meth)) == NULL) \
-	return NULL; \
-    ret = PyObject_Call(method, args, kw); \
-    Py_DECREF(method); \
-    return ret; \
-}
+	/* Remove space-stuffing and find trailing SPACE of flowed line. */
+	if (start < eol && s[start] == 0x0020)
+	    start++;
+	end = (start < eol && s[eol - 1] == 0x0020) ? eol - 1 : eol;
 
-LineBreak_dictmethod_varargs(get)
-LineBreak_dictmethod_varargs(setdefault)
-LineBreak_dictmethod_varargs(pop)
-LineBreak_dictmethod_noargs(popitem)
-LineBreak_dictmethod_noargs(keys)
-LineBreak_dictmethod_noargs(items)
-LineBreak_dictmethod_noargs(values)
-LineBreak_dictmethod_keywords(update)
-LineBreak_dictmethod_noargs(clear)
-LineBreak_dictmethod_noargs(copy)
+	if (flowed && prefix != nquote &&
+	    unistr_append(buf, siz, newline->str, newline->len) != 0)
+	    return -1;
+	if (nquote && (!flowed || prefix != nquote) &&
+	    (unistr_append(buf, siz, s + pos, nquote) != 0 ||
+	     unistr_append(buf, siz, &space, 1) != 0))
+	    return -1;
+	if (unistr_append(buf, siz, s + start, end - start) != 0)
+	    return -1;
 
-/*
- * Class-specific methods
- */
+	if (end == eol) {
+	    if (unistr_append(buf, siz, newline->str, newline->len) != 0)
+		return -1;
+	    flowed = 0;
+	} else {
+	    if (!delsp && unistr_append(buf, siz, &space, 1) != 0)
+		return -1;
+	    flowed = 1;
+	    prefix = nquote;
+	}
+    }
+    return 0;
+}
 
-PyDoc_STRVAR(LineBreak_Copy__doc__, "\
-Copy LineBreak object.");
+PyDoc_STRVAR(LineBreak_unfold__doc__, "\
+S.unfold(text[, method[, newline]]) -> unicode\n\
+\n\
+Conjunct folded paragraphs of a Unicode string *text* and returns it.\n\
+*method* is one of ``\"fixed\"`` (default), ``\"flowed\"`` and\n\
+``\"flowedsp\"``; see :func:`textseg.unfold`.  Newline sequences are\n\
+replaced by *newline* (default is LF).  Following instance attributes of\n\
+LineBreak object S will affect to conjunction of \"fixed\" lines as\n\
+:meth:`breakingRule` does.");
 
 static PyObject *
-LineBreak_Copy(PyObject * self, PyObject * args)
+LineBreak_unfold(PyObject * self, PyObject * args, PyObject * kwds)
 {
-    linebreak_t *lb;
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
+    static char *keywords[] = { "text", "method", "newline", NULL };
+    PyObject *str, *pymethod = NULL, *pynewline = NULL, *owner, *ret;
+    unistr_t text, newline = { NULL, 0 }, buf = { NULL, 0 };
+    unichar_t lf = 0x000A, *s, c;
+    char *method;
+    size_t siz = 0, len, i, start;
+    int fixed = 1, delsp = 0, r = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", keywords,
+				     &str, &pymethod, &pynewline))
+	return NULL;
+
+    if (pymethod != NULL && pymethod != Py_None) {
+	if ((method = genericstr_ToString(pymethod)) == NULL)
+	    return NULL;
+	if (strcasecmp(method, "flowed") == 0) {
+	    fixed = 0;
+	    delsp = 1;
+	} else if (strcasecmp(method, "flowedsp") == 0)
+	    fixed = 0;
+	free(method);
+    }
+    if (pynewline == NULL || pynewline == Py_None) {
+	newline.str = &lf;
+	newline.len = 1;
+    } else if (unicode_ToCstruct(&newline, pynewline) == NULL)
+	return NULL;
+
+    if (unicode_BorrowCstruct(&text, str, &owner) == NULL) {
+	if (newline.str != &lf)
+	    free(newline.str);
+	return NULL;
+    }
 
-    if ((lb = linebreak_copy(LineBreak_AS_CSTRUCT(self))) == NULL) {
+    /* Replace CR LF and CR with LF. */
+    if (text.len == 0)
+	s = NULL;
+    else if ((s = malloc(sizeof(unichar_t) * text.len)) == NULL) {
 	PyErr_SetFromErrno(PyExc_RuntimeError);
+	r = -1;
+    }
+    for (i = 0, len = 0; r == 0 && i < text.len; i++) {
+	c = text.str[i];
+	if (c == 0x000D) {
+	    if (i + 1 < text.len && text.str[i + 1] == 0x000A)
+		i++;
+	    c = 0x000A;
+	}
+	s[len++] = c;
+    }
+    unicode_ReleaseCstruct(&text, owner);
+
+    /* Unfold each segment between special breaks VT, FF, NEL, LS and PS. */
+    for (i = 0, start = 0; r == 0 && i <= len; i++) {
+	if (i < len) {
+	    c = s[i];
+	    if (c != 0x000B && c != 0x000C && c != 0x0085 &&
+		c != 0x2028 && c != 0x2029)
+		continue;
+	}
+	if (fixed)
+	    r = unfold_fixed(lb, &buf, &siz, s + start, i - start,
+			     &newline);
+	else
+	    r = unfold_flowed(&buf, &siz, s + start, i - start, &newline,
+			      delsp);
+	if (r == 0 && i < len)
+	    r = unistr_append(&buf, &siz, s + i, 1);
+	start = i + 1;
+    }
+
+    free(s);
+    if (newline.str != &lf)
+	free(newline.str);
+    if (r != 0) {
+	free(buf.str);
 	return NULL;
     }
-    return LineBreak_FromCstruct(Py_TYPE(self), lb);
+    ret = unicode_FromCstruct(&buf);
+    free(buf.str);
+    return ret;
 }
 
-PyDoc_STRVAR(LineBreak_breakingRule__doc__, "\
-S.rule(before, after) -> int\n\
-\n\
-Get possible line breaking behavior between strings *before* and *after*.\n\
-Returned value is one of:\n\
-\n\
-``MANDATORY``\n\
-    :term:`Mandatory break`.\n\
-``DIRECT``\n\
-    Both :term:`direct break` and :term:`indirect break` are allowed.\n\
-``INDIRECT``\n\
-    Indirect break is allowed but direct break is prohibited.\n\
-``PROHIBITED``\n\
-    Breaking is prohibited.\n\
-\n\
-Following instance attributes of LineBreak object S will affect to result.\n\
-\n\
-- :attr:`eastasian_context`\n\
-- :attr:`hangul_as_al`\n\
-- :attr:`lbc`\n\
-- :attr:`legacy_cm`\n\
+PyDoc_STRVAR(LineBreak_fold_text__doc__, "\
+S.fold_text(text[, parallel=False]) -> unicode\n\
 \n\
-.. note::\n\
-   This method gives just approximate description of line breaking\n\
-   behavior.  Use :meth:`wrap<LineBreak.wrap>` method or \n\
-   :ref:`other functions<Functions>` to fold actual texts.");
+Break a Unicode string *text* and returns lines contained in the result\n\
+concatenated into one Unicode string.  Text is divided at VT, FF, NEL,\n\
+LS and PS, which are kept in the result, and each part is broken as\n\
+:meth:`wrap` does.  No :class:`GCStr` objects are created.\n\
+See :meth:`wrap` about *parallel*.");
 
 static PyObject *
-LineBreak_breakingRule(PyObject * self, PyObject * args)
+LineBreak_fold_text(PyObject * self, PyObject * args, PyObject * kwds)
 {
     linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
-    PyObject *before, *after;
-    gcstring_t *bgcstr, *agcstr;
-    propval_t blbc, albc, ret;
-
-    if (!PyArg_ParseTuple(args, "OO", &before, &after))
-        return NULL;
-    if ((bgcstr = genericstr_ToCstruct(before, lb)) == NULL)
+    static char *keywords[] = { "text", "parallel", NULL };
+    PyObject *str, *parallel = NULL, *ret;
+    breakinput_t in;
+    gcstring_t **broken;
+    linebreak_t *lbobj;
+    unistr_t buf = { NULL, 0 };
+    unichar_t c = 0;
+    size_t siz = 0, i, j, start;
+    int nthreads, r = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", keywords,
+				     &str, &parallel))
 	return NULL;
-    if (bgcstr->gclen == 0) {
-	if (! GCStr_Check(before))
-	    gcstring_destroy(bgcstr);
-	Py_RETURN_NONE;
-    }
-    if ((agcstr = genericstr_ToCstruct(after, lb)) == NULL) {
-	if (! GCStr_Check(before))
-	    gcstring_destroy(bgcstr);
+    if ((nthreads = parallel_ToThreads(parallel)) < 0)
+	return NULL;
+    if (!linebreak_is_builtin(lb))
+	nthreads = 1;
+    if ((lbobj = LineBreak_AcquireCstruct(self)) == NULL)
+	return NULL;
+    if (breakinput_init(&in, str) != 0) {
+	LineBreak_ReleaseCstruct(self, lbobj);
 	return NULL;
     }
-    if (agcstr->gclen == 0) {
-	if (! GCStr_Check(before))
-	    gcstring_destroy(bgcstr);
-	if (! GCStr_Check(after))
-	    gcstring_destroy(agcstr);
-	Py_RETURN_NONE;
-    }
-
-    blbc = gcstring_lbclass_ext(bgcstr, -1);
-    albc = gcstring_lbclass(agcstr, 0);
-    ret = linebreak_get_lbrule(lb, blbc, albc);
 
-    if (! GCStr_Check(before))
-	gcstring_destroy(bgcstr);
-    if (! GCStr_Check(after))
-	gcstring_destroy(agcstr);
+    for (i = 0, start = 0; r == 0 && i <= in.len; i++) {
+	if (i < in.len) {
+	    c = breakinput_char(&in, i);
+	    if (c != 0x000B && c != 0x000C && c != 0x0085 &&
+		c != 0x2028 && c != 0x2029)
+		continue;
+	}
+	if (start < i) {
+	    if (1 < nthreads)
+		broken = do_break_parallel(lb, &in, start, i - start,
+					   nthreads);
+	    else
+		broken = do_break_input(lbobj, self, &in, start, i - start);
+	    if (broken == NULL)
+		r = -1;
+	    for (j = 0; r == 0 && broken[j] != NULL; j++)
+		r = unistr_append(&buf, &siz, broken[j]->str,
+				  broken[j]->len);
+	    if (broken != NULL)
+		linebreak_free_result(broken, 1);
+	}
+	if (r == 0 && i < in.len)
+	    r = unistr_append(&buf, &siz, &c, 1);
+	start = i + 1;
+    }
+    breakinput_release(&in);
+    LineBreak_ReleaseCstruct(self, lbobj);
 
-    if (ret == PROP_UNKNOWN) {
-	Py_RETURN_NONE;
+    if (r != 0) {
+	free(buf.str);
+	return NULL;
     }
-    return PyInt_FromLong((long)ret);
+    ret = unicode_FromCstruct(&buf);
+    free(buf.str);
+    return ret;
 }
 
-PyDoc_STRVAR(LineBreak_wrap__doc__, "\
-S.wrap(text) -> [GCStr]\n\
+PyDoc_STRVAR(LineBreak_freeze__doc__, "\
+S.freeze() -> LineBreak\n\
 \n\
-Break a Unicode string *text* and returns list of lines contained in the\n\
-result.  Each item of list is grapheme cluster string (:class:`GCStr`\n\
-object).");
+Returns frozen copy of LineBreak object S.  Attributes, tailoring and\n\
+items of frozen object can not be modified, and :meth:`feed` and\n\
+:meth:`flush` are not available.  Frozen object may be used by several\n\
+threads at once: each breaking uses private state which is kept for\n\
+later breakings.");
 
 static PyObject *
-LineBreak_wrap(PyObject * self, PyObject * args)
+LineBreak_freeze(PyObject * self, PyObject * args)
 {
-    linebreak_t *lb = LineBreak_AS_CSTRUCT(self);
-    PyObject *str, *ret;
-    PyTypeObject *gcstr_type;
-    unistr_t unistr = { NULL, 0 };
-    gcstring_t **broken;
-    size_t i;
+    linebreak_t *lb;
+    PyObject *dict, *stash, *ret;
 
-    if (!PyArg_ParseTuple(args, "O", &str))
-	return NULL;
-    if (unicode_ToCstruct(&unistr, str) == NULL)
+    if (FrozenLineBreak_Check(self)) {
+	Py_INCREF(self);
+	return self;
+    }
+    if ((lb = break_copy(LineBreak_AS_CSTRUCT(self))) == NULL) {
+	PyErr_SetFromErrno(PyExc_RuntimeError);
 	return NULL;
-
+    }
     linebreak_reset(lb);
-    broken = linebreak_break(lb, &unistr);
-    free(unistr.str);
-    if (PyErr_Occurred()) {
-	linebreak_free_result(broken, 1);
+
+    /* Items are copied into read-only mapping. */
+    if ((dict = PyDict_Copy(STASH_DICT(lb))) == NULL) {
+	linebreak_destroy(lb);
 	return NULL;
-    } else if (broken == NULL) {
-	if (lb->errnum == LINEBREAK_ELONG)
-	    PyErr_SetString((PyObject *)STASH_EXCEPTION(lb),
-			    "Excessive line was found");
-	else if (lb->errnum) {
-	    errno = lb->errnum;
-	    PyErr_SetFromErrno(PyExc_RuntimeError);
-	} else
-	    PyErr_SetString(PyExc_RuntimeError, "unknown error");
+    }
+    stash = Py_BuildValue("(NOOO)", PyDictProxy_New(dict),
+			  (PyObject *) STASH_TYPE(lb),
+			  (PyObject *) STASH_GCSTRTYPE(lb),
+			  (PyObject *) STASH_EXCEPTION(lb));
+    Py_DECREF(dict);
+    if (stash == NULL) {
+	linebreak_destroy(lb);
 	return NULL;
     }
+    linebreak_set_stash(lb, stash);
+    Py_DECREF(stash);		/* fixup */
 
-    if (GCStr_Check(str))
-	gcstr_type = Py_TYPE(str);
-    else
-	gcstr_type = STASH_GCSTRTYPE(lb);
-
-    ret = PyList_New(0);
-    for (i = 0; broken[i] != NULL; i++) {
-	PyObject *v;
-	if ((v = GCStr_FromCstruct(gcstr_type, broken[i])) == NULL) {
-	    Py_DECREF(ret);
-	    for ( ; broken[i] != NULL; i++)
-		gcstring_destroy(broken[i]);
-	    linebreak_free_result(broken, 0);
-	    return NULL;
-	}
-	PyList_Append(ret, v);
+    if ((ret = LineBreak_FromCstruct(&FrozenLineBreak_Type, lb)) == NULL) {
+	linebreak_destroy(lb);
+	return NULL;
     }
-    linebreak_free_result(broken, 0);
-
-    Py_INCREF(ret);
+    ((LineBreakObject *) ret)->tabsize = ((LineBreakObject *) self)->tabsize;
     return ret;
 }
 
@@ -2098,8 +5006,32 @@ static PyMethodDef LineBreak_methods[] = {
      (PyCFunction) LineBreak_breakingRule, METH_VARARGS,
      LineBreak_breakingRule__doc__},
     {"wrap",
-     (PyCFunction) LineBreak_wrap, METH_VARARGS,
+     (PyCFunction) LineBreak_wrap, METH_VARARGS | METH_KEYWORDS,
      LineBreak_wrap__doc__},
+    {"iwrap",
+     (PyCFunction) LineBreak_iwrap, METH_VARARGS,
+     LineBreak_iwrap__doc__},
+    {"wrap_many",
+     (PyCFunction) LineBreak_wrap_many, METH_VARARGS | METH_KEYWORDS,
+     LineBreak_wrap_many__doc__},
+    {"feed",
+     (PyCFunction) LineBreak_feed, METH_VARARGS,
+     LineBreak_feed__doc__},
+    {"flush",
+     (PyCFunction) LineBreak_flush, METH_NOARGS,
+     LineBreak_flush__doc__},
+    {"breakpoints",
+     (PyCFunction) LineBreak_breakpoints, METH_VARARGS,
+     LineBreak_breakpoints__doc__},
+    {"freeze",
+     (PyCFunction) LineBreak_freeze, METH_NOARGS,
+     LineBreak_freeze__doc__},
+    {"unfold",
+     (PyCFunction) LineBreak_unfold, METH_VARARGS | METH_KEYWORDS,
+     LineBreak_unfold__doc__},
+    {"fold_text",
+     (PyCFunction) LineBreak_fold_text, METH_VARARGS | METH_KEYWORDS,
+     LineBreak_fold_text__doc__},
 
     {"get", (PyCFunction)LineBreak_get, METH_VARARGS, NULL},
     {"setdefault", (PyCFunction)LineBreak_setdefault, METH_VARARGS, NULL},
@@ -2121,6 +5053,14 @@ static PyMethodDef LineBreak_methods[] = {
 };
 
 
+static int
+LineBreak_setattro(PyObject * self, PyObject * name, PyObject * value)
+{
+    if (LineBreak_Unshare(self) != 0)
+	return -1;
+    return PyObject_GenericSetAttr(self, name, value);
+}
+
 static PyTypeObject LineBreak_Type = {
 #if PY_MAJOR_VERSION >= 3
     PyVarObject_HEAD_INIT(NULL, 0)
@@ -2144,7 +5084,7 @@ static PyTypeObject LineBreak_Type = {
     0,				/*tp_call */
     0,				/*tp_str */
     0,				/*tp_getattro */
-    0,				/*tp_setattro */
+    LineBreak_setattro,		/*tp_setattro */
     0,				/*tp_as_buffer */
     Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,	/*tp_flags */
     "LineBreak objects",	/* tp_doc */
@@ -2167,47 +5107,557 @@ static PyTypeObject LineBreak_Type = {
     LineBreak_new,		/* tp_new */
 };
 
+/**
+ * FrozenLineBreak class
+ */
+
+static void
+FrozenLineBreak_dealloc(FrozenLineBreakObject * self)
+{
+    while (self->nidle)
+	linebreak_destroy(self->idle[--self->nidle]);
+    LineBreak_dealloc((LineBreakObject *) self);
+}
+
+static PyObject *
+FrozenLineBreak_new(PyTypeObject * type, PyObject * args, PyObject * kwds)
+{
+    PyErr_SetString(PyExc_TypeError,
+		    "frozen LineBreak object is made by LineBreak.freeze()");
+    return NULL;
+}
+
+static int
+FrozenLineBreak_init(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    return LineBreak_CheckWritable(self);
+}
+
+static int
+FrozenLineBreak_setattro(PyObject * self, PyObject * name, PyObject * value)
+{
+    return LineBreak_CheckWritable(self);
+}
+
+static PyObject *
+FrozenLineBreak_readonly(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    LineBreak_CheckWritable(self);
+    return NULL;
+}
+
+static PyObject *
+FrozenLineBreak_Copy(PyObject * self, PyObject * args)
+{
+    Py_INCREF(self);
+    return self;
+}
+
+static PyMethodDef FrozenLineBreak_methods[] = {
+    {"__copy__",
+     (PyCFunction) FrozenLineBreak_Copy, METH_NOARGS,
+     LineBreak_Copy__doc__},
+    {"feed",
+     (PyCFunction) FrozenLineBreak_readonly, METH_VARARGS | METH_KEYWORDS,
+     LineBreak_feed__doc__},
+    {"flush",
+     (PyCFunction) FrozenLineBreak_readonly, METH_VARARGS | METH_KEYWORDS,
+     LineBreak_flush__doc__},
+
+    {"setdefault", (PyCFunction) FrozenLineBreak_readonly,
+     METH_VARARGS | METH_KEYWORDS, NULL},
+    {"pop", (PyCFunction) FrozenLineBreak_readonly,
+     METH_VARARGS | METH_KEYWORDS, NULL},
+    {"popitem", (PyCFunction) FrozenLineBreak_readonly,
+     METH_VARARGS | METH_KEYWORDS, NULL},
+    {"update", (PyCFunction) FrozenLineBreak_readonly,
+     METH_VARARGS | METH_KEYWORDS, NULL},
+    {"clear", (PyCFunction) FrozenLineBreak_readonly,
+     METH_VARARGS | METH_KEYWORDS, NULL},
+
+    {NULL}			/* Sentinel */
+};
+
+static PyTypeObject FrozenLineBreak_Type = {
+#if PY_MAJOR_VERSION >= 3
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else				/* PY_MAJOR_VERSION */
+    PyObject_HEAD_INIT(NULL)
+    0,				/*ob_size */
+#endif				/* PY_MAJOR_VERSION */
+    "_textseg.FrozenLineBreak",	/*tp_name */
+    sizeof(FrozenLineBreakObject),	/*tp_basicsize */
+    0,				/*tp_itemsize */
+    (destructor)FrozenLineBreak_dealloc,	/*tp_dealloc */
+    0,				/*tp_print */
+    0,				/*tp_getattr */
+    0,				/*tp_setattr */
+    0,				/*tp_compare */
+    0,				/*tp_repr */
+    0,				/*tp_as_number */
+    0,				/*tp_as_sequence */
+    0,				/*tp_as_mapping */
+    0,				/*tp_hash */
+    0,				/*tp_call */
+    0,				/*tp_str */
+    0,				/*tp_getattro */
+    FrozenLineBreak_setattro,	/*tp_setattro */
+    0,				/*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,		/*tp_flags */
+    "Frozen LineBreak objects",	/* tp_doc */
+    0,				/* tp_traverse */
+    0,				/* tp_clear */
+    0,				/* tp_richcompare */
+    0,				/* tp_weaklistoffset */
+    0,				/* tp_iter */
+    0,				/* tp_iternext */
+    FrozenLineBreak_methods,	/* tp_methods */
+    0,				/* tp_members */
+    0,				/* tp_getset */
+    &LineBreak_Type,		/* tp_base */
+    0,				/* tp_dict */
+    0,				/* tp_descr_get */
+    0,				/* tp_descr_set */
+    0,				/* tp_dictoffset */
+    FrozenLineBreak_init,	/* tp_init */
+    0,				/* tp_alloc */
+    FrozenLineBreak_new,	/* tp_new */
+};
+
 /**
  ** TailoringDict class
  **/
 
 static void
-TDict_dealloc(TDictObject * self)
+TDict_dealloc(TDictObject * self)
+{
+    /* remove linkage from LineBreak object */
+    if (self->lb != NULL) {
+	if (self->next != NULL)
+	    self->next->prev = self->prev;
+	if (self->prev != NULL)
+	    self->prev->next = self->next;
+	else
+	    ((LineBreakObject *)self->lb)->tdict = self->next;
+    }
+
+    Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *
+TDict_FromLineBreak(PyObject *lb, tdicttype ttype)
+{
+    TDictObject * self;
+
+    assert(LineBreak_Check(lb));
+
+    if ((self = (TDictObject *)TDict_Type.tp_alloc(&TDict_Type, 0)) == NULL)
+        return NULL;
+
+    self->ttype = ttype;
+    self->lb = lb;
+
+    /* add linkage to LineBreak object */
+    self->prev = NULL;
+    self->next = ((LineBreakObject *) lb)->tdict;
+    if (self->next != NULL)
+	self->next->prev = self;
+    ((LineBreakObject *) lb)->tdict = self;
+
+    return (PyObject *) self;
+}
+
+/*
+ * Ranges of tailoring
+ */
+
+typedef struct {
+    unichar_t beg;
+    unichar_t end;
+    propval_t p;
+    size_t idx;
+} tdictrange_t;
+
+typedef struct {
+    tdictrange_t *ranges;
+    size_t len;
+    size_t siz;
+} tdictranges_t;
+
+static int
+tdictrange_cmp(const void *a, const void *b)
+{
+    const tdictrange_t *x = a, *y = b;
+
+    if (x->beg != y->beg)
+	return (x->beg < y->beg) ? -1 : 1;
+    if (x->idx != y->idx)
+	return (x->idx < y->idx) ? -1 : 1;
+    return 0;
+}
+
+static int
+tdictrange_boundcmp(const void *a, const void *b)
+{
+    const unsigned long *x = a, *y = b;
+
+    return (*x < *y) ? -1 : (*x > *y) ? 1 : 0;
+}
+
+/*
+ * Append range of characters beg - end (inclusive) with property value p.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+tdictranges_add(tdictranges_t * rs, unichar_t beg, unichar_t end,
+		propval_t p)
+{
+    tdictrange_t *r;
+    size_t siz;
+
+    if (end < beg)
+	return 0;
+    if (rs->len && rs->ranges[rs->len - 1].p == p &&
+	rs->ranges[rs->len - 1].end != (unichar_t)(-1) &&
+	rs->ranges[rs->len - 1].end + 1 == beg) {
+	rs->ranges[rs->len - 1].end = end;
+	return 0;
+    }
+    if (rs->siz <= rs->len) {
+	siz = rs->siz ? rs->siz * 2 : 16;
+	if ((r = realloc(rs->ranges, sizeof(tdictrange_t) * siz)) == NULL) {
+	    PyErr_NoMemory();
+	    return -1;
+	}
+	rs->ranges = r;
+	rs->siz = siz;
+    }
+    r = rs->ranges + rs->len;
+    r->beg = beg;
+    r->end = end;
+    r->p = p;
+    r->idx = rs->len;
+    rs->len++;
+    return 0;
+}
+
+/*
+ * Get a code point from range boundary obj.  If chr is true, obj may be a
+ * character.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static long
+tdictrange_bound(PyObject * obj, int chr, long max)
+{
+    long c;
+
+    if (PyInt_Check(obj))
+	c = PyInt_AsLong(obj);
+    else if (PyLong_Check(obj))
+	c = PyLong_AsLong(obj);
+    else if (chr) {
+	unichar_t u;
+
+	if ((u = strOrInt_ToUCS(obj)) == (unichar_t)(-1))
+	    return -1;
+	c = (long) u;
+    }
+    else {
+	PyErr_Format(PyExc_TypeError,
+		     "range bound must be integer, not %200s",
+		     Py_TYPE(obj)->tp_name);
+	return -1;
+    }
+    if (c == -1 && PyErr_Occurred())
+	return -1;
+    if (c < 0 || max < c) {
+	PyErr_Format(PyExc_ValueError, "code point out of range: %ld", c);
+	return -1;
+    }
+    return c;
+}
+
+/*
+ * Append characters specified by key with property value p.  key may be a
+ * range object, a sequence of characters or code points, or single one.
+ * If pair is true, key may also be a pair (start, end) of inclusive bounds.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+tdictranges_add_key(tdictranges_t * rs, PyObject * key, propval_t p,
+		    int pair)
+{
+    PyObject *item;
+    long beg, end;
+    unichar_t c;
+    Py_ssize_t i, len;
+
+#if PY_MAJOR_VERSION >= 3
+    if (PyRange_Check(key)) {
+	PyObject *start, *stop, *stepobj;
+	long step;
+
+	start = PyObject_GetAttrString(key, "start");
+	stop = PyObject_GetAttrString(key, "stop");
+	stepobj = PyObject_GetAttrString(key, "step");
+	if (start == NULL || stop == NULL || stepobj == NULL) {
+	    Py_XDECREF(start);
+	    Py_XDECREF(stop);
+	    Py_XDECREF(stepobj);
+	    return -1;
+	}
+	step = PyLong_AsLong(stepobj);
+	if (step == 1) {
+	    /* stop is exclusive. */
+	    beg = tdictrange_bound(start, 0, 0x10FFFF);
+	    end = (beg == -1) ? -1 : tdictrange_bound(stop, 0, 0x110000);
+	}
+	Py_DECREF(start);
+	Py_DECREF(stop);
+	Py_DECREF(stepobj);
+	if (step == 1) {
+	    if (beg == -1 || end == -1)
+		return -1;
+	    if (beg < end)
+		return tdictranges_add(rs, (unichar_t) beg,
+				       (unichar_t) (end - 1), p);
+	    return 0;
+	}
+	PyErr_Clear();
+    }
+#endif				/* PY_MAJOR_VERSION */
+    if (pair && PyTuple_Check(key) && PyTuple_GET_SIZE(key) == 2) {
+	if ((beg = tdictrange_bound(PyTuple_GET_ITEM(key, 0), 1,
+				    0x10FFFF)) == -1 ||
+	    (end = tdictrange_bound(PyTuple_GET_ITEM(key, 1), 1,
+				    0x10FFFF)) == -1)
+	    return -1;
+	return tdictranges_add(rs, (unichar_t) beg, (unichar_t) end, p);
+    }
+    if (PySequence_Check(key)) {
+	if ((len = PySequence_Size(key)) == -1)
+	    return -1;
+	for (i = 0; i < len; i++) {
+	    if ((item = PySequence_GetItem(key, i)) == NULL)
+		return -1;
+	    c = strOrInt_ToUCS(item);
+	    Py_DECREF(item);
+	    if (c == (unichar_t)(-1) ||
+		tdictranges_add(rs, c, c, p) != 0)
+		return -1;
+	}
+	return 0;
+    }
+    if ((c = strOrInt_ToUCS(key)) == (unichar_t)(-1))
+	return -1;
+    return tdictranges_add(rs, c, c, p);
+}
+
+/*
+ * Push range r onto heap of active ranges ordered by idx, largest first.
+ */
+static void
+tdictrange_heappush(tdictrange_t ** heap, size_t * len, tdictrange_t * r)
+{
+    size_t i, parent;
+
+    for (i = (*len)++; 0 < i; i = parent) {
+	parent = (i - 1) / 2;
+	if (r->idx < heap[parent]->idx)
+	    break;
+	heap[i] = heap[parent];
+    }
+    heap[i] = r;
+}
+
+/*
+ * Remove top of heap of active ranges.
+ */
+static void
+tdictrange_heappop(tdictrange_t ** heap, size_t * len)
 {
-    /* remove linkage from LineBreak object */
-    if (self->lb != NULL) {
-	if (self->next != NULL)
-	    self->next->prev = self->prev;
-	if (self->prev != NULL)
-	    self->prev->next = self->next;
-	else
-	    ((LineBreakObject *)self->lb)->tdict = self->next;
+    tdictrange_t *r = heap[--(*len)];
+    size_t i, child;
+
+    for (i = 0; (child = i * 2 + 1) < *len; i = child) {
+	if (child + 1 < *len && heap[child]->idx < heap[child + 1]->idx)
+	    child++;
+	if (heap[child]->idx < r->idx)
+	    break;
+	heap[i] = heap[child];
     }
+    if (*len)
+	heap[i] = r;
+}
 
-    Py_TYPE(self)->tp_free(self);
+/*
+ * Resolve ranges into sorted and disjoint ones.  Where ranges overlap, the
+ * one assigned later, i.e. having larger idx, wins.  Adjacent ranges with
+ * the same value are coalesced.  Ranges are swept at each boundary of them
+ * keeping heap of ranges covering it, so that the result won't depend on
+ * order of sorting.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+tdictranges_resolve(tdictranges_t * rs)
+{
+    tdictrange_t *out, *r, **heap;
+    unsigned long *bounds, pos;
+    size_t i, j, nbounds, nheap, len;
+
+    bounds = malloc(sizeof(unsigned long) * rs->len * 2);
+    heap = malloc(sizeof(tdictrange_t *) * rs->len);
+    out = malloc(sizeof(tdictrange_t) * rs->len * 2);
+    if (bounds == NULL || heap == NULL || out == NULL) {
+	free(bounds);
+	free(heap);
+	free(out);
+	PyErr_NoMemory();
+	return -1;
+    }
+
+    qsort(rs->ranges, rs->len, sizeof(tdictrange_t), tdictrange_cmp);
+    for (i = 0; i < rs->len; i++) {
+	bounds[i * 2] = (unsigned long) rs->ranges[i].beg;
+	bounds[i * 2 + 1] = (unsigned long) rs->ranges[i].end + 1;
+    }
+    qsort(bounds, rs->len * 2, sizeof(unsigned long), tdictrange_boundcmp);
+    for (i = 1, nbounds = 1; i < rs->len * 2; i++)
+	if (bounds[nbounds - 1] != bounds[i])
+	    bounds[nbounds++] = bounds[i];
+
+    for (i = 0, j = 0, nheap = 0, len = 0; i + 1 < nbounds; i++) {
+	pos = bounds[i];
+	for (; j < rs->len && rs->ranges[j].beg <= pos; j++)
+	    tdictrange_heappush(heap, &nheap, rs->ranges + j);
+	while (nheap && heap[0]->end < pos)
+	    tdictrange_heappop(heap, &nheap);
+	if (nheap == 0)
+	    continue;
+
+	r = (len == 0) ? NULL : out + len - 1;
+	if (r != NULL && r->p == heap[0]->p &&
+	    (unsigned long) r->end + 1 == pos)
+	    r->end = (unichar_t) (bounds[i + 1] - 1);
+	else {
+	    r = out + len;
+	    r->beg = (unichar_t) pos;
+	    r->end = (unichar_t) (bounds[i + 1] - 1);
+	    r->p = heap[0]->p;
+	    r->idx = len;
+	    len++;
+	}
+    }
+    free(bounds);
+    free(heap);
+
+    free(rs->ranges);
+    rs->ranges = out;
+    rs->len = len;
+    rs->siz = rs->len * 2;
+    return 0;
 }
 
-static PyObject *
-TDict_FromLineBreak(PyObject *lb, tdicttype ttype)
+/*
+ * Merge ranges into tailoring map of TailoringDict object self at once.
+ * Ranges are resolved into sorted and disjoint ones where latter
+ * assignment wins, then merged by a map of temporary linebreak object.
+ * Ranges are freed.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+tdictranges_merge(PyObject * self, tdictranges_t * rs)
 {
-    TDictObject * self;
+    TDictObject * tdict = (TDictObject *)self;
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(tdict->lb), *diff;
+    mapent_t *map;
+    size_t i, len;
 
-    assert(LineBreak_Check(lb));
+    if (rs->len == 0) {
+	free(rs->ranges);
+	return 0;
+    }
 
-    if ((self = (TDictObject *)TDict_Type.tp_alloc(&TDict_Type, 0)) == NULL)
-        return NULL;
+    if (tdictranges_resolve(rs) != 0) {
+	free(rs->ranges);
+	return -1;
+    }
+    len = rs->len;
 
-    self->ttype = ttype;
-    self->lb = lb;
+    if ((map = malloc(sizeof(mapent_t) * len)) == NULL) {
+	free(rs->ranges);
+	PyErr_NoMemory();
+	return -1;
+    }
+    for (i = 0; i < len; i++) {
+	map[i].beg = rs->ranges[i].beg;
+	map[i].end = rs->ranges[i].end;
+	map[i].lbc = map[i].eaw = map[i].gcb = map[i].scr = PROP_UNKNOWN;
+	if (tdict->ttype == TDICT_LBC)
+	    map[i].lbc = rs->ranges[i].p;
+	else
+	    map[i].eaw = rs->ranges[i].p;
+    }
+    free(rs->ranges);
 
-    /* add linkage to LineBreak object */
-    self->prev = NULL;
-    self->next = ((LineBreakObject *) lb)->tdict;
-    if (self->next != NULL)
-	self->next->prev = self;
-    ((LineBreakObject *) lb)->tdict = self;
+    if ((diff = linebreak_new(NULL)) == NULL) {
+	free(map);
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+	return -1;
+    }
+    diff->map = map;
+    diff->mapsiz = len;
+    if (tdict->ttype == TDICT_LBC)
+	linebreak_merge_lbclass(lb, diff);
+    else
+	linebreak_merge_eawidth(lb, diff);
+    linebreak_destroy(diff);
+    if (lb->errnum) {
+	errno = lb->errnum;
+	lb->errnum = 0;
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+	return -1;
+    }
+    return 0;
+}
 
-    return (PyObject *) self;
+/*
+ * Check if tailoring map of TailoringDict object self may be modified.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+tdict_check_writable(PyObject * self)
+{
+    TDictObject * tdict = (TDictObject *)self;
+
+    if (tdict->lb == NULL) {
+	PyErr_SetString(PyExc_AttributeError, "parent object has gone");
+	return -1;
+    }
+    if (LineBreak_CheckWritable(tdict->lb) != 0 ||
+	LineBreak_Unshare(tdict->lb) != 0)
+	return -1;
+    return 0;
+}
+
+/*
+ * Get property value from obj.
+ * If error occurred, exception will be raised and -1 will be returned.
+ */
+static int
+tdict_value(PyObject * obj, propval_t * p)
+{
+    if (PyInt_Check(obj))
+	*p = (propval_t) PyInt_AsLong(obj);
+    else if (PyLong_Check(obj))
+	*p = (propval_t) PyLong_AsLong(obj);
+    else {
+	PyErr_Format(PyExc_ValueError,
+		     "value must be integer, not %200s",
+		     Py_TYPE(obj)->tp_name);
+	return -1;
+    }
+    return 0;
 }
 
 /*
@@ -2242,57 +5692,22 @@ TDict_subscript(PyObject * self, PyObject * key)
 static int
 TDict_ass_subscript(PyObject * self, PyObject * key, PyObject * value)
 {
-    TDictObject * tdict = (TDictObject *)self;
-    PyObject *item;
-    unichar_t c;
+    tdictranges_t rs = { NULL, 0, 0 };
     propval_t p;
-    size_t i;
 
     if (value == NULL) {
 	PyErr_SetString(PyExc_NotImplementedError,
 			"Can not cancel tailoring by each");
 	return -1;
     }
-    if (tdict->lb == NULL) {
-	PyErr_SetString(PyExc_AttributeError, "parent object has gone");
+    if (tdict_check_writable(self) != 0 || tdict_value(value, &p) != 0)
 	return -1;
-    }
 
-    if (PyInt_Check(value))
-	p = (propval_t) PyInt_AsLong(value);
-    else if (PyLong_Check(value))
-	p = (propval_t) PyLong_AsLong(value);
-    else {
-	PyErr_Format(PyExc_ValueError,
-		     "value must be integer, not %200s",
-		     Py_TYPE(value)->tp_name);
+    if (tdictranges_add_key(&rs, key, p, 0) != 0) {
+	free(rs.ranges);
 	return -1;
     }
-
-    if (PySequence_Check(key)) {
-	for (i = 0; (item = PySequence_GetItem(key, i)) != NULL; i++) {
-	    if ((c = strOrInt_ToUCS(item)) == (unichar_t)(-1)) {
-		Py_DECREF(item);
-		return -1;
-	    }
-	    if (tdict->ttype == TDICT_LBC)
-		linebreak_update_lbclass(LineBreak_AS_CSTRUCT(tdict->lb),
-					 c, p);
-	    else
-		linebreak_update_eawidth(LineBreak_AS_CSTRUCT(tdict->lb),
-					 c, p);
-	    Py_DECREF(item);
-	}
-	PyErr_Clear();
-	return 0;
-    }
-    if ((c = strOrInt_ToUCS(key)) == (unichar_t)(-1))
-	return -1;
-    if (tdict->ttype == TDICT_LBC)
-	linebreak_update_lbclass(LineBreak_AS_CSTRUCT(tdict->lb), c, p);
-    else
-	linebreak_update_eawidth(LineBreak_AS_CSTRUCT(tdict->lb), c, p);
-    return 0;
+    return tdictranges_merge(self, &rs);
 }
 
 static int
@@ -2312,6 +5727,11 @@ tdict_clear(PyObject *self)
 static PyObject *
 TDict_clear(PyObject *self)
 {
+    PyObject *lb = ((TDictObject *) self)->lb;
+
+    if (lb != NULL &&
+	(LineBreak_CheckWritable(lb) != 0 || LineBreak_Unshare(lb) != 0))
+	return NULL;
     if (tdict_clear(self) != 0)
 	return NULL;
     Py_RETURN_NONE;
@@ -2366,6 +5786,9 @@ tdict_update(PyObject * tdict, PyObject * arg, int clear)
 
 	return -1;
     }
+    if (LineBreak_CheckWritable(((TDictObject *) tdict)->lb) != 0 ||
+	LineBreak_Unshare(((TDictObject *) tdict)->lb) != 0)
+	return -1;
     dst = LineBreak_AS_CSTRUCT(((TDictObject *) tdict)->lb);
     if (TDict_CheckExact(arg)) {
 	if (((TDictObject *) arg)->lb == NULL) {
@@ -2460,6 +5883,45 @@ TDict_update(PyObject *self, PyObject *args, PyObject *kwds)
     Py_RETURN_NONE;
 }
 
+static PyObject *
+TDict_update_ranges(PyObject *self, PyObject *arg)
+{
+    tdictranges_t rs = { NULL, 0, 0 };
+    PyObject *iter, *item, *key, *value;
+    propval_t p;
+
+    if (tdict_check_writable(self) != 0)
+	return NULL;
+    if (PyDict_Check(arg)) {
+	if ((item = PyDict_Items(arg)) == NULL)
+	    return NULL;
+	iter = PyObject_GetIter(item);
+	Py_DECREF(item);
+    } else
+	iter = PyObject_GetIter(arg);
+    if (iter == NULL)
+	return NULL;
+
+    while ((item = PyIter_Next(iter)) != NULL) {
+	if (! PyArg_ParseTuple(item, "OO", &key, &value) ||
+	    tdict_value(value, &p) != 0 ||
+	    tdictranges_add_key(&rs, key, p, 1) != 0) {
+	    Py_DECREF(item);
+	    break;
+	}
+	Py_DECREF(item);
+    }
+    Py_DECREF(iter);
+    if (PyErr_Occurred()) {
+	free(rs.ranges);
+	return NULL;
+    }
+
+    if (tdictranges_merge(self, &rs) != 0)
+	return NULL;
+    Py_RETURN_NONE;
+}
+
 /*
  * Method for debugging use
  */
@@ -2507,6 +5969,7 @@ static PyMethodDef TDict_methods[] = {
     {"setdefault", (PyCFunction) TDict_setdefault, METH_VARARGS, NULL},
     {"update", (PyCFunction) TDict_update, METH_VARARGS | METH_KEYWORDS,
      NULL},
+    {"update_ranges", (PyCFunction) TDict_update_ranges, METH_O, NULL},
     {"_dump", (PyCFunction) TDict_dump, METH_NOARGS, NULL},
     {NULL,		NULL}   /* sentinel */
 };
@@ -2559,6 +6022,172 @@ static PyTypeObject TDict_Type = {
 };
 
 
+/**
+ ** LineBreakIterator class
+ **/
+
+typedef struct {
+    PyObject_HEAD
+    /* LineBreak object created iterator. */
+    PyObject *owner;
+    /* Private copy of linebreak object, or NULL after end of text. */
+    linebreak_t *obj;
+    breakinput_t in;
+    /* Number of characters passed to obj. */
+    size_t pos;
+    PyTypeObject *gcstr_type;
+    /* Lines not yet returned. */
+    gcstring_t **broken;
+    size_t idx;
+} LineBreakIterObject;
+
+static void
+LineBreakIter_dealloc(LineBreakIterObject * self)
+{
+    size_t i;
+
+    if (self->broken != NULL) {
+	for (i = self->idx; self->broken[i] != NULL; i++)
+	    gcstring_destroy(self->broken[i]);
+	linebreak_free_result(self->broken, 0);
+    }
+    if (self->obj != NULL)
+	linebreak_destroy(self->obj);
+    breakinput_release(&self->in);
+    Py_XDECREF(self->gcstr_type);
+    Py_XDECREF(self->owner);
+    Py_TYPE(self)->tp_free(self);
+}
+
+/*
+ * Create iterator breaking str by a copy of linebreak object of LineBreak
+ * object owner.
+ */
+static PyObject *
+LineBreakIter_New(PyObject * owner, PyObject * str)
+{
+    linebreak_t *lb = LineBreak_AS_CSTRUCT(owner);
+    LineBreakIterObject *self;
+
+    if ((self = (LineBreakIterObject *)
+	 LineBreakIter_Type.tp_alloc(&LineBreakIter_Type, 0)) == NULL)
+	return NULL;
+    Py_INCREF(owner);
+    self->owner = owner;
+    self->obj = NULL;
+    self->in.owner = NULL;
+    self->in.unistr.str = NULL;
+    self->in.unistr.len = 0;
+    self->pos = 0;
+    self->broken = NULL;
+    self->idx = 0;
+
+    if (GCStr_Check(str))
+	self->gcstr_type = Py_TYPE(str);
+    else
+	self->gcstr_type = STASH_GCSTRTYPE(lb);
+    Py_INCREF(self->gcstr_type);
+
+    if (breakinput_init(&self->in, str) != 0) {
+	Py_DECREF(self);
+	return NULL;
+    }
+    if ((self->obj = break_copy(lb)) == NULL) {
+	PyErr_SetFromErrno(PyExc_RuntimeError);
+	Py_DECREF(self);
+	return NULL;
+    }
+    linebreak_reset(self->obj);
+    return (PyObject *) self;
+}
+
+/*
+ * Return next line.  Text is broken by each small window, or at once if
+ * prep regexes are used, only when no lines are left.
+ */
+static PyObject *
+LineBreakIter_iternext(LineBreakIterObject * self)
+{
+    gcstring_t **broken;
+    PyObject *ret;
+    size_t len;
+
+    while (self->broken == NULL || self->broken[self->idx] == NULL) {
+	if (self->broken != NULL) {
+	    linebreak_free_result(self->broken, 0);
+	    self->broken = NULL;
+	}
+	if (self->obj == NULL)
+	    return NULL;
+
+	if (self->pos < self->in.len) {
+	    len = self->in.len - self->pos;
+	    /* Matches of prep regexes might cross windows. */
+	    if (BREAK_WINDOW_SIZE < len && self->obj->prep_func == NULL)
+		len = BREAK_WINDOW_SIZE;
+	    broken = do_break_partial(self->obj, self->owner, &self->in,
+				      self->pos, len);
+	    self->pos += len;
+	} else {
+	    broken = do_break_partial(self->obj, self->owner, NULL, 0, 0);
+	    /* Lines not yet returned refer the copy by themselves. */
+	    linebreak_destroy(self->obj);
+	    self->obj = NULL;
+	}
+	if (broken == NULL) {
+	    if (self->obj != NULL) {
+		linebreak_destroy(self->obj);
+		self->obj = NULL;
+	    }
+	    return NULL;
+	}
+	self->broken = broken;
+	self->idx = 0;
+    }
+
+    if ((ret = GCStr_FromCstruct(self->gcstr_type,
+				 self->broken[self->idx])) == NULL)
+	return NULL;
+    self->idx++;
+    return ret;
+}
+
+static PyTypeObject LineBreakIter_Type = {
+#if PY_MAJOR_VERSION >= 3
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else				/* PY_MAJOR_VERSION */
+    PyObject_HEAD_INIT(NULL)
+    0,				/*ob_size */
+#endif				/* PY_MAJOR_VERSION */
+    "_textseg.LineBreakIterator",	/*tp_name */
+    sizeof(LineBreakIterObject),	/*tp_basicsize */
+    0,				/*tp_itemsize */
+    (destructor)LineBreakIter_dealloc,	/*tp_dealloc */
+    0,				/*tp_print */
+    0,				/*tp_getattr */
+    0,				/*tp_setattr */
+    0,				/*tp_compare */
+    0,				/*tp_repr */
+    0,				/*tp_as_number */
+    0,				/*tp_as_sequence */
+    0,				/*tp_as_mapping */
+    0,				/*tp_hash */
+    0,				/*tp_call */
+    0,				/*tp_str */
+    0,				/*tp_getattro */
+    0,				/*tp_setattro */
+    0,				/*tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,		/*tp_flags */
+    "LineBreakIterator objects",	/* tp_doc */
+    0,				/* tp_traverse */
+    0,				/* tp_clear */
+    0,				/* tp_richcompare */
+    0,				/* tp_weaklistoffset */
+    PyObject_SelfIter,		/* tp_iter */
+    (iternextfunc)LineBreakIter_iternext,	/* tp_iternext */
+};
+
+
 /**
  ** GCStr class
  **/
@@ -2570,7 +6199,13 @@ static PyTypeObject TDict_Type = {
 static void
 GCStr_dealloc(PyObject * self)
 {
-    gcstring_destroy(GCStr_AS_CSTRUCT(self));
+    GCStrObject *obj = (GCStrObject *) self;
+
+    if (obj->obj == &obj->empty) {
+	if (obj->empty.lbobj != NULL)
+	    linebreak_destroy(obj->empty.lbobj);
+    } else if (!obj->view)
+	gcstring_destroy(obj->obj);
     Py_TYPE(self)->tp_free(self);
 }
 
@@ -2895,6 +6530,8 @@ GCStr_ass_item(PyObject * self, Py_ssize_t i, PyObject * v)
 			"object doesn't support item deletion");
 	return -1;
     }
+    if (GCStr_Own(self) != 0)
+	return -1;
     if ((repl = genericstr_ToCstruct(v, GCStr_AS_CSTRUCT(self)->lbobj))
 	== NULL)
 	return -1;
@@ -2908,7 +6545,7 @@ GCStr_ass_item(PyObject * self, Py_ssize_t i, PyObject * v)
     }
 
     if (!GCStr_Check(v))
-	gcstring_destroy(gcstr);
+	gcstring_destroy(repl);
     return 0;
 }
 
@@ -2917,8 +6554,11 @@ GCStr_ass_slice(PyObject * self, Py_ssize_t start, Py_ssize_t end,
 		PyObject * v)
 {
     gcstring_t *gcstr, *repl;
-    linebreak_t *lb = GCStr_AS_CSTRUCT(self)->lbobj;
+    linebreak_t *lb;
 
+    if (GCStr_Own(self) != 0)
+	return -1;
+    lb = GCStr_AS_CSTRUCT(self)->lbobj;
     if (v == NULL)
 	repl = gcstring_new(NULL, lb);
     else if ((repl = genericstr_ToCstruct(v, lb)) == NULL)
@@ -3012,7 +6652,11 @@ static int
 GCStr_ass_subscript(PyObject * self, PyObject * item, PyObject * v)
 {
     Py_ssize_t k;
-    gcstring_t *gcstr = GCStr_AS_CSTRUCT(self);
+    gcstring_t *gcstr;
+
+    if (GCStr_Own(self) != 0)
+	return -1;
+    gcstr = GCStr_AS_CSTRUCT(self);
 
 #if PY_MAJOR_VERSION == 2 && PY_MINOR_VERSION <= 4
     if (PyInt_Check(item))
@@ -3135,13 +6779,16 @@ Predefined flag values are:\n\
 static PyObject *
 GCStr_flag(PyObject * self, PyObject * args)
 {
-    gcstring_t *gcstr = GCStr_AS_CSTRUCT(self);
+    gcstring_t *gcstr;
     Py_ssize_t i;
     long v = -1L;
     PyObject *ret;
 
     if (!PyArg_ParseTuple(args, ARG_FORMAT_SSIZE_T "|i", &i, &v))
 	return NULL;
+    if (0 < v && GCStr_Own(self) != 0)
+	return NULL;
+    gcstr = GCStr_AS_CSTRUCT(self);
     if (i < 0 || gcstr->gclen <= i) {
 	Py_RETURN_NONE;
     }
@@ -3280,6 +6927,10 @@ init_textseg(void)
 	Py_DECREF(LineBreakException);
 	INITERROR;
     }
+    if (PyType_Ready(&FrozenLineBreak_Type) < 0) {
+	Py_DECREF(LineBreakException);
+	INITERROR;
+    }
     if (PyType_Ready(&GCStr_Type) < 0) {
 	Py_DECREF(LineBreakException);
 	INITERROR;
@@ -3288,6 +6939,14 @@ init_textseg(void)
 	Py_DECREF(LineBreakException);
 	INITERROR;
     }
+    if (PyType_Ready(&LineBreakIter_Type) < 0) {
+	Py_DECREF(LineBreakException);
+	INITERROR;
+    }
+    if (PyType_Ready(&FormatState_Type) < 0) {
+	Py_DECREF(LineBreakException);
+	INITERROR;
+    }
 #if PY_MAJOR_VERSION >= 3
     m = PyModule_Create(&textseg_def);
 #else				/* PY_MAJOR_VERSION */
@@ -3302,17 +6961,26 @@ init_textseg(void)
     PyModule_AddObject(m, "LineBreakException", LineBreakException);
     Py_INCREF(&LineBreak_Type);
     PyModule_AddObject(m, "LineBreak", (PyObject *) & LineBreak_Type);
+    Py_INCREF(&FrozenLineBreak_Type);
+    PyModule_AddObject(m, "FrozenLineBreak",
+		       (PyObject *) & FrozenLineBreak_Type);
     Py_INCREF(&GCStr_Type);
     PyModule_AddObject(m, "GCStr", (PyObject *) & GCStr_Type);
     Py_INCREF(&TDict_Type);
     PyModule_AddObject(m, "TailoringDict", (PyObject *) & TDict_Type);
 
+    if ((searchctx_key = PyString_FromString("_textseg.searchctx")) == NULL)
+	INITERROR;
+
     TEXTSEG_SIMPLE = PyString_FromString("simple");
     TEXTSEG_NEWLINE = PyString_FromString("newline");
     TEXTSEG_TRIM = PyString_FromString("trim");
+    TEXTSEG_FIXED = PyString_FromString("fixed");
+    TEXTSEG_FLOWED = PyString_FromString("flowed");
     TEXTSEG_BREAKURI = PyString_FromString("breakuri");
     TEXTSEG_NONBREAKURI = PyString_FromString("nonbreakuri");
     TEXTSEG_UAX11 = PyString_FromString("uax11");
+    TEXTSEG_UAX11_TABS = PyString_FromString("uax11_tabs");
     TEXTSEG_FORCE = PyString_FromString("force");
     TEXTSEG_RAISE = PyString_FromString("raise");
 
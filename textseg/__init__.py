@@ -18,7 +18,7 @@ grapheme cluster segmentation.
 # specified in the README file.
 
 __all__ = ['Consts', 'GCStr', 'LineBreak', 'LineBreakException',
-           'fill', 'fold', 'unfold', 'wrap']
+           'TextWrapper', 'fill', 'fold', 'unfold', 'wrap']
 
 import re
 import _textseg
@@ -28,12 +28,110 @@ try:
 except ImportError:
     from email.Charset import Charset
 
+try:
+    import threading
+except ImportError:
+    import dummy_threading as threading
+
 try:
     unicode, unichr
 except NameError:
     unicode = str
     unichr = chr
 
+###
+### Cache of LineBreak objects
+###
+
+class _LineBreakCache(object):
+    '''\
+Bounded LRU cache of idle LineBreak objects keyed by their options.
+A LineBreak object is taken out while it is used, so that it is never
+used by several threads at once.'''
+
+    def __init__(self, maxsize = 16):
+        self.maxsize = maxsize
+        self.lock = threading.Lock()
+        self.idle = {}
+        self.order = []     # keys, least recently used first
+        self.size = 0
+
+    def key(self, tag, kwds):
+        '''Get key from tag and options, or None if they are unhashable.
+Defaults of options are merged into kwds, so that changes of them are
+concerned.'''
+        for k, v in list(LineBreak.DEFAULTS.items()):
+            kwds.setdefault(k, v)
+        key = (tag, tuple(sorted([(k, self.freeze(v))
+                                  for k, v in kwds.items()])))
+        try:
+            hash(key)
+        except TypeError:
+            return None
+        return key
+
+    def freeze(self, value):
+        '''Convert dicts and lists in value to tuples.  Items of dict keep
+their order, since tailoring by later items overrides earlier ones.'''
+        if isinstance(value, dict):
+            return (dict, tuple([(k, self.freeze(v))
+                                 for k, v in value.items()]))
+        if isinstance(value, (list, tuple)):
+            return (type(value), tuple([self.freeze(v) for v in value]))
+        return value
+
+    def get(self, key):
+        '''Take LineBreak object out, or return None if not cached.'''
+        if key is None:
+            return None
+        self.lock.acquire()
+        try:
+            lbs = self.idle.get(key)
+            if lbs is None:
+                return None
+            lb = lbs.pop()
+            if not len(lbs):
+                del self.idle[key]
+                self.order.remove(key)
+            self.size -= 1
+            return lb
+        finally:
+            self.lock.release()
+
+    def put(self, key, lb):
+        '''Return LineBreak object to be reused.'''
+        if key is None:
+            return
+        self.lock.acquire()
+        try:
+            if key in self.idle:
+                self.order.remove(key)
+                self.idle[key].append(lb)
+            else:
+                self.idle[key] = [lb]
+            self.order.append(key)
+            self.size += 1
+            while self.maxsize < self.size:
+                lbs = self.idle[self.order[0]]
+                del lbs[0]
+                if not len(lbs):
+                    del self.idle[self.order[0]]
+                    del self.order[0]
+                self.size -= 1
+        finally:
+            self.lock.release()
+
+    def clear(self):
+        self.lock.acquire()
+        try:
+            self.idle.clear()
+            del self.order[:]
+            self.size = 0
+        finally:
+            self.lock.release()
+
+_linebreaks = _LineBreakCache()
+
 ###
 ### Function wrap()
 ###
@@ -70,37 +168,58 @@ For other named arguments see instance attributes of :class:`LineBreak`
 class.
 '''
 
-    def format(self, action, s):
-        if action.startswith('eo'):
-            return self.newline
-        if action in ('sot', 'sop'):
-            return s * 0 + initial_indent + s
-        if action == 'sol':
-            return s * 0 + subsequent_indent + s
-        if action == '':
-            if s == initial_indent or s == subsequent_indent:
-                return ''
-        return None
+    _wrap_kwds(width, break_long_words, kwds)
+    key = _linebreaks.key('wrap', kwds)
+    lb = _linebreaks.get(key)
+    if lb is None:
+        lb = LineBreak(**kwds)
+    result = _wrap(lb, text, initial_indent, subsequent_indent,
+                   expand_tabs, replace_whitespace)
+    _linebreaks.put(key, lb)
+    return result
 
-    if expand_tabs:
-        text = GCStr(text).expandtabs()
-    if replace_whitespace:
-        table = {}
-        for c in unicode('\t\n\x0b\x0c\r '):
-            table[c] = unicode(' ')
-        if isinstance(text, GCStr):
-            text = text * 0 + unicode(text).translate(table)
-        else:
-            text = text.translate(table)
+def _wrap_format(self, action, s):
+    initial_indent = self['initial_indent']
+    subsequent_indent = self['subsequent_indent']
+    if action.startswith('eo'):
+        return self.newline
+    if action in ('sot', 'sop'):
+        return s * 0 + initial_indent + s
+    if action == 'sol':
+        return s * 0 + subsequent_indent + s
+    if action == '':
+        if s == initial_indent or s == subsequent_indent:
+            return ''
+    return None
 
+def _wrap_kwds(width, break_long_words, kwds):
     for k, v in list({ 'charmax': 0,
-                       'format': format,
+                       'format': _wrap_format,
                        'newline': '',
                        'urgent': (break_long_words and "FORCE" or None),
                        'width': width,
                      }.items()):
         kwds.setdefault(k, v)
-    lb = LineBreak(**kwds)
+    return kwds
+
+_whitespace_table = {}
+for c in unicode('\t\n\x0b\x0c\r '):
+    _whitespace_table[c] = unicode(' ')
+del c
+
+def _wrap(lb, text, initial_indent, subsequent_indent,
+          expand_tabs, replace_whitespace):
+    if expand_tabs:
+        text = GCStr(text).expandtabs()
+    if replace_whitespace:
+        if isinstance(text, GCStr):
+            text = text * 0 + unicode(text).translate(_whitespace_table)
+        else:
+            text = text.translate(_whitespace_table)
+
+    # Indents are referred by _wrap_format().
+    lb['initial_indent'] = initial_indent
+    lb['subsequent_indent'] = subsequent_indent
     return [unicode(s) for s in lb.wrap(text)]
 
 ###
@@ -120,76 +239,80 @@ function.'''
     return unicode("\n").join(wrap(text, **kwds))
 
 ###
-### Function fold()
+### Class TextWrapper
 ###
 
-def _fold_FIXED(self, action, s):
-    if action in ('sot', 'sop'):
-        self['_'] = {}
-        self['_']['width'] = self.width
-        if s.startswith('>'):
-            self.width = 0
-    elif action == '':
-        self['_']['line'] = s
-    elif action == 'eol':
-        return self.newline
-    elif action.startswith('eo'):
-        if len(self['_']['line']) and self.width:
-            s = self.newline + self.newline
-        else:
-            s = self.newline
-        self.width = self['_']['width']
-        del self['_']
-        return s
-    return None
+class TextWrapper(object):
+    '''\
+TextWrapper class keeps options of :func:`wrap<textseg.wrap>` function
+and a LineBreak object configured by them, so that many texts may be
+wrapped without configuring LineBreak object each time.'''
+
+    def __init__(self,
+                 width = 70,
+                 initial_indent = "",
+                 subsequent_indent = "",
+                 expand_tabs = True,
+                 replace_whitespace = True,
+                 fix_sentence_endings = False,
+                 break_long_words = True,
+                 break_on_hyphens = True,
+                 drop_whitespace = True,
+                 **kwds):
+        '''\
+TextWrapper([options...]) -> TextWrapper
 
-_prefixRe = re.compile(r'^>+')
-def _fold_FLOWED(self, action, s):
-    if action == 'sol':
-        if len(self['_']['prefix']):
-            return self['_']['prefix'] + ' ' + s
-        elif s.startswith(' ') or s.startswith('From ') or s.startswith('>'):
-            return ' ' + s
-    elif action.startswith('so'):
-        self['_'] = {}
-        m = _prefixRe.match(unicode(s))
-        if m:
-            self['_']['prefix'] = m.group()
-        else:
-            self['_']['prefix'] = ''
-            if s.startswith(' ') or s.startswith('From '):
-                return ' ' + s
-    elif action == '':
-        self['_']['line'] = s
-    elif action == 'eol':
-        if len(s):
-            s = ' '
-        return s + ' ' + self.newline
-    elif action.startswith('eo'):
-        if len(self['_']['line']) and not len(self['_']['prefix']):
-            s = ' ' + self.newline + self.newline
-        else:
-            s = self.newline
-        del self['_']
-        return s
-    return None
+Create new TextWrapper object.  Options are the same as
+:func:`wrap<textseg.wrap>` function.  Configured LineBreak object is
+given by :attr:`linebreak` attribute.
+'''
+        self.initial_indent = initial_indent
+        self.subsequent_indent = subsequent_indent
+        self.expand_tabs = expand_tabs
+        self.replace_whitespace = replace_whitespace
+        self.linebreak = LineBreak(**_wrap_kwds(width, break_long_words,
+                                                kwds))
+        self._lock = threading.Lock()
+
+    def wrap(self, text):
+        '''\
+S.wrap(text) -> [unicode]
 
-def _fold_PLAIN(self, action, s):
-    if action.startswith('eo'):
-        return self.newline
-    return None
+Wrap paragraphs of a text then return a list of wrapped lines.
+See :func:`wrap<textseg.wrap>`.'''
+
+        # If LineBreak object is used by another thread, use its copy.
+        if not self._lock.acquire(False):
+            return _wrap(self.linebreak.__copy__(), text,
+                         self.initial_indent, self.subsequent_indent,
+                         self.expand_tabs, self.replace_whitespace)
+        try:
+            return _wrap(self.linebreak, text,
+                         self.initial_indent, self.subsequent_indent,
+                         self.expand_tabs, self.replace_whitespace)
+        finally:
+            self._lock.release()
+
+    def fill(self, text):
+        '''\
+S.fill(text) -> unicode
 
-_fold_funcs = {'flowed': _fold_FLOWED,
-               'fixed': _fold_FIXED,
-               'plain': _fold_PLAIN,
-               }
+Reformat the single paragraph in *text* and return a new string containing
+the entire wrapped paragraph.  See :func:`fill<textseg.fill>`.'''
 
-_specialBreakRe = re.compile('([' + unichr(0xB) + unichr(0xC) +
-                             unichr(0x85) + unichr(0x2028) + unichr(0x2029) +
-                             '])', re.S)
+        return unicode("\n").join(self.wrap(text))
+
+###
+### Function fold()
+###
+
+_fold_formats = {'flowed': 'FLOWED',
+                 'fixed': 'FIXED',
+                 'plain': 'NEWLINE',
+                 }
 
 def fold(string, method = 'plain', tabsize = 8,
-         charset = None, language = None, **kwds):
+         charset = None, language = None, parallel = False, **kwds):
     """\
 fold(string[, method, options...]) -> unicode
 
@@ -214,24 +337,12 @@ Horizontal tabs are treated as tab stops according to *tabsize* argument.
 *charset* or *language* is used to determine language/region context:
 East Asian or not.
 
+If *parallel* is true, paragraphs are folded in parallel where possible.
+See :meth:`LineBreak.wrap`.
+
 For other named arguments see instance attributes of :class:`LineBreak`
 class.
 """
-    def sizing(self, cols, pre, spc, s):
-        spcstr = spc + s
-        i = 0
-        for c in spcstr:
-            if c.lbc != lbcSP:
-                cols += spcstr[i:].cols
-                break
-            if c == "\t":
-                if 0 < tabsize:
-                    cols += tabsize - (cols % tabsize)
-            else:
-                cols += c.cols
-            i = i + 1
-        return cols
-
     if string is None or not len(string):
         return ''
     if not isinstance(string, unicode):
@@ -248,23 +359,20 @@ class.
     else:
         eastasian_context = None
 
-    kwds.update({'format': _fold_funcs.get(method.lower(), _fold_PLAIN),
-                 'sizing': sizing,
+    kwds.update({'format': _fold_formats.get(method.lower(), 'NEWLINE'),
+                 'sizing': 'UAX11_TABS',
+                 'tabsize': max(tabsize, 0),
                  })
     if eastasian_context is not None:
         kwds['eastasian_context'] = eastasian_context
 
-    lb = LineBreak(**kwds)
-    lb.lbc["\t"] = lbcSP
-
-    result = ''
-    for s in _specialBreakRe.split(string):
-        if not len(s):
-            continue
-        elif _specialBreakRe.match(s):
-            result += s
-        else:
-            result += ''.join([unicode(l) for l in lb.wrap(s)])
+    key = _linebreaks.key('fold', kwds)
+    lb = _linebreaks.get(key)
+    if lb is None:
+        lb = LineBreak(**kwds)
+        lb.lbc["\t"] = lbcSP
+    result = lb.fold_text(string, parallel=parallel)
+    _linebreaks.put(key, lb)
     return result
 
 ###
@@ -287,96 +395,17 @@ Following options may be specified for *method* argument.
 ``"flowedsp"``
     Unfold "Format=Flowed; DelSp=No" formatting defined by :rfc:`3676`.
 '''
-    def reMatch(regexp, s, pos):
-        # keep result of matching as an attribute of function itself.
-        reMatch.m = re.compile(regexp).match(s, pos)
-        return reMatch.m
-
     if not isinstance(string, unicode):
         string = unicode(string)
     if not len(string):
         return string
-    string = re.sub(r'\r\n|\r', "\n", string)    
-
-    method = method.lower()
-    if method not in ('fixed', 'flowed', 'flowedsp'):
-        method = 'fixed'
-    delsp = (method == 'flowed')
-
-    ## Do unfolding.
-    result = '';
-    for s in _specialBreakRe.split(string):
-        if s == '':
-            continue
-        elif _specialBreakRe.match(s):
-            result += s
-            continue
-        elif method == 'fixed':
-            lb = LineBreak(**kwds)
-            pos = 0
-            while pos < len(s):
-                if reMatch(r'\n', s, pos):
-                    result += newline
-                elif reMatch(r'(.+)\n\n', s, pos):
-                    result += reMatch.m.group(1) + newline
-                elif reMatch(r'(>.*)\n', s, pos):
-                    result += reMatch.m.group(1) + newline
-                elif reMatch(r'(.+)\n(?=>)', s, pos):
-                    result += reMatch.m.group(1) + newline
-                elif reMatch(r'(.+?)( *)\n(?=(.+))', s, pos):
-                    sl, ss, sn = reMatch.m.group(1, 2, 3)
-                    result += sl
-                    if sn.startswith(' '):
-                        result += newline
-                    elif len(ss):
-                        result += ss
-                    elif len(sl):
-                        if lb.breakingRule(sl, sn) == LineBreak.INDIRECT:
-                            result += ' '
-                elif reMatch(r'(.+)\n', s, pos):
-                    result += reMatch.m.group(1) + newline
-                elif reMatch(r'(.+)', s, pos):
-                    result += reMatch.m.group(1) + newline
-                    break
-                pos += len(reMatch.m.group(0))
-        else:
-            prefix = None
-            pos = 0
-            while pos < len(s):
-                if reMatch(r'(>+) ?(.*?)( ?)\n', s, pos):
-                    sp, sl, ss = reMatch.m.group(1, 2, 3)
-                    if prefix is None:
-                        result += sp + ' ' + sl
-                    elif sp != prefix:
-                        result += newline + sp + ' ' + sl
-                    else:
-                        result += sl
-                    if not len(ss):
-                        result += newline
-                        prefix = None
-                    else:
-                        prefix = sp
-                        if not delsp:
-                            result += ss
-                elif reMatch(r' ?(.*?)( ?)\n', s, pos):
-                    sl, ss = reMatch.m.group(1, 2)
-                    if prefix is None:
-                        result += sl
-                    elif prefix != '':
-                        result += newline + sl
-                    else:
-                        result += sl
-                    if not len(ss):
-                        result += newline
-                        prefix = None
-                    else:
-                        if not delsp:
-                            result += ss
-                        prefix = ''
-                elif reMatch(r' ?(.*)', s, pos):
-                    result += reMatch.m.group(1) + newline
-                    break
-                pos += len(reMatch.m.group(0))
+
+    key = _linebreaks.key('unfold', kwds)
+    lb = _linebreaks.get(key)
+    if lb is None:
+        lb = LineBreak(**kwds)
+    result = lb.unfold(string, method, newline)
+    _linebreaks.put(key, lb)
     return result
 
 ###